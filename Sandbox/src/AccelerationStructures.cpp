@@ -4,7 +4,30 @@
 
 //=================== BLAS =====================
 
-void BLAS::SetObject(std::vector<tinybvh::bvhvec4>& vertices)
+void BLAS::SetObject(std::vector<tinybvh::bvhvec4>& vertices, BuildQuality quality)
+{
+	TakeVertices(vertices);
+	BuildBinaryBVH(quality);
+	ConvertBinaryBVH();
+}
+
+void BLAS::SetObject(std::vector<tinybvh::bvhvec4>& vertices, const BLASCache& cache, BuildQuality quality)
+{
+	TakeVertices(vertices);
+
+	// The cache holds the binary BVH, converting it to the wide layout is linear in the node count
+	tinybvh::BVH& bvh = GetBinaryBVH();
+	if (!cache.Load(bvh, m_Vertices))
+	{
+		BuildBinaryBVH(quality);
+		if (quality == BuildQuality::High)
+			cache.Store(bvh, m_Vertices, false);
+	}
+
+	ConvertBinaryBVH();
+}
+
+void BLAS::TakeVertices(std::vector<tinybvh::bvhvec4>& vertices)
 {
 #if defined(__AVX2__)
 	m_BVH = tinybvh::BVH8_CPU();
@@ -16,8 +39,43 @@ void BLAS::SetObject(std::vector<tinybvh::bvhvec4>& vertices)
 	m_Vertices = std::vector<tinybvh::bvhvec4>();
 	m_Vertices.insert(m_Vertices.end(), std::make_move_iterator(vertices.begin()), std::make_move_iterator(vertices.end()));
 	vertices.clear();
+}
 
-	m_BVH.BuildHQ(m_Vertices.data(), m_Vertices.size() / 3);
+tinybvh::BVH& BLAS::GetBinaryBVH()
+{
+#if defined(__AVX2__)
+	return m_BVH.bvh8.bvh;
+#elif defined(__AVX__)
+	return m_BVH.bvh;
+#else
+	return m_BVH.bvh4.bvh;
+#endif
+}
+
+void BLAS::BuildBinaryBVH(BuildQuality quality)
+{
+	tinybvh::BVH& bvh = GetBinaryBVH();
+	if (quality == BuildQuality::High)
+		bvh.BuildHQ(m_Vertices.data(), m_Vertices.size() / 3);
+#if defined(BVH_USEAVX)
+	else
+		bvh.BuildAVX(m_Vertices.data(), m_Vertices.size() / 3);
+#else
+	else
+		bvh.Build(m_Vertices.data(), m_Vertices.size() / 3);
+#endif
+}
+
+void BLAS::ConvertBinaryBVH()
+{
+	// Same conversions BuildHQ ends with
+#if defined(__AVX2__)
+	m_BVH.ConvertFrom(m_BVH.bvh8);
+#elif defined(__AVX__)
+	m_BVH.ConvertFrom(m_BVH.bvh, false);
+#else
+	m_BVH.ConvertFrom(m_BVH.bvh4);
+#endif
 }
 
 
@@ -25,76 +83,188 @@ void BLAS::SetObject(std::vector<tinybvh::bvhvec4>& vertices)
 
 void TLAS::Build()
 {
-	m_TLAS->Build(m_BLASInstances.data(), m_BLASInstances.size(), m_BVHPointers.data(), m_BLASList.size());
+	InstanceState& state = *m_InstanceState;
+	m_TLAS->Build(state.blasInstances.data(), state.blasInstances.size(), state.bvhPointers.data(), state.bvhPointers.size());
+	state.needsBuild = false;
+	state.buildSurfaceArea = CalcSurfaceArea();
+}
+
+void TLAS::Update()
+{
+	UpdateTransform();
+
+	const InstanceState& state = *m_InstanceState;
+	if (state.needsBuild || state.movedCount > RefitMaxMovedRatio * state.blasInstances.size())
+	{
+		Build();
+		return;
+	}
+
+	if (state.movedCount == 0)
+		return;
+
+	Refit();
+
+	if (CalcSurfaceArea() > RebuildSurfaceAreaRatio * state.buildSurfaceArea)
+		Build();
 }
 
-uint32_t TLAS::AddBLAS(const std::shared_ptr<BLAS>& blas, const Transform& transform)
+void TLAS::Refit()
 {
-	uint32_t index = m_BLASList.size();
+	// tinybvh refuses to refit a TLAS, but instance bounds refit like triangle bounds.
+	// Children are always stored after their parent, so a reverse sweep updates bottom-up.
+	const InstanceState& state = *m_InstanceState;
+	for (int32_t i = static_cast<int32_t>(m_TLAS->usedNodes) - 1; i >= 0; i--)
+	{
+		// Node 1 is unused padding
+		if (i == 1)
+			continue;
 
+		tinybvh::BVH::BVHNode& node = m_TLAS->bvhNode[i];
+		if (node.isLeaf())
+		{
+			node.aabbMin = tinybvh::bvhvec3(BVH_FAR);
+			node.aabbMax = tinybvh::bvhvec3(-BVH_FAR);
+			for (uint32_t j = 0; j < node.triCount; j++)
+			{
+				const tinybvh::BLASInstance& instance = state.blasInstances[m_TLAS->primIdx[node.leftFirst + j]];
+				node.aabbMin = tinybvh::tinybvh_min(node.aabbMin, instance.aabbMin);
+				node.aabbMax = tinybvh::tinybvh_max(node.aabbMax, instance.aabbMax);
+			}
+			continue;
+		}
+
+		const tinybvh::BVH::BVHNode& left = m_TLAS->bvhNode[node.leftFirst];
+		const tinybvh::BVH::BVHNode& right = m_TLAS->bvhNode[node.leftFirst + 1];
+		node.aabbMin = tinybvh::tinybvh_min(left.aabbMin, right.aabbMin);
+		node.aabbMax = tinybvh::tinybvh_max(left.aabbMax, right.aabbMax);
+	}
+
+	m_TLAS->aabbMin = m_TLAS->bvhNode[0].aabbMin;
+	m_TLAS->aabbMax = m_TLAS->bvhNode[0].aabbMax;
+}
+
+float TLAS::CalcSurfaceArea() const
+{
+	float surfaceArea = 0.0f;
+	for (uint32_t i = 0; i < m_TLAS->usedNodes; i++)
+	{
+		if (i == 1)
+			continue;
+
+		const tinybvh::BVH::BVHNode& node = m_TLAS->bvhNode[i];
+		tinybvh::bvhvec3 extent = node.aabbMax - node.aabbMin;
+		surfaceArea += extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+
+	return surfaceArea;
+}
+
+uint32_t TLAS::AddBLAS(const std::shared_ptr<BLAS>& blas)
+{
+	uint32_t blasHandle = m_BLASList.size();
 	m_BLASList.push_back(blas);
-	m_Transforms.push_back(transform);
-	m_PrevTransforms->push_back(transform);
+	m_InstanceState->bvhPointers.push_back(blas->GetBVHPointer());
+	// tinybvh keeps the BVH pointer array, a grown array may have moved
+	m_InstanceState->needsBuild = true;
+
+	return blasHandle;
+}
+
+uint32_t TLAS::AddInstance(uint32_t blasHandle, const Transform& transform, uint32_t mask)
+{
+	uint32_t index = m_Instances.size();
+	InstanceState& state = *m_InstanceState;
 
-	m_TransformMatrices.push_back(transform.GetTransformMatrix());
-	m_InverseTransformMatrices.push_back(transform.GetInverseTransformMatrix());
-	m_ToPreviousPositionMatrices.push_back(glm::mat4(1.0f));
+	m_Instances.push_back({ blasHandle, transform, mask });
+	state.prevTransforms.push_back(transform);
 
-	m_BVHPointers.push_back(m_BLASList[index]->GetBVHPointer());
-	m_BLASInstances.emplace_back(index);
+	state.transformMatrices.push_back(transform.GetTransformMatrix());
+	state.inverseTransformMatrices.push_back(transform.GetInverseTransformMatrix());
+	state.toPreviousPositionMatrices.push_back(glm::mat4(1.0f));
+	state.moved.push_back(false);
 
-	m_TriangleCount += blas->GetVertices().size() / 3;
+	state.blasInstances.emplace_back(blasHandle);
+	state.blasInstances[index].mask = mask & RayMaskAll;
+	WriteInstanceTransform(index);
+	state.needsBuild = true;
+
+	m_TriangleCount += m_BLASList[blasHandle]->GetVertices().size() / 3;
 
 	return index;
 }
 
 void TLAS::UpdateTransform()
 {
-	for (int i = 0; i < m_BLASList.size(); i++)
+	InstanceState& state = *m_InstanceState;
+	state.movedCount = 0;
+	state.masksChanged = false;
+	for (uint32_t i = 0; i < m_Instances.size(); i++)
 	{
-		// Going world and object space conversion
-		m_TransformMatrices[i] = m_Transforms[i].GetTransformMatrix(); // Object space to world space
-
-		// Calculate ToPreviousPositionMatrix
-		if ((*m_PrevTransforms)[i] != m_Transforms[i])
+		// Masks don't affect the bounds, the BVH stays as is
+		uint32_t mask = m_Instances[i].mask & RayMaskAll;
+		if (state.blasInstances[i].mask != mask)
 		{
-			// Current position to prev position in object space
-			glm::vec3 translationDelta = (*m_PrevTransforms)[i].translation - m_Transforms[i].translation;
-			glm::vec3 rotationDelta = (*m_PrevTransforms)[i].rotation - m_Transforms[i].rotation;
-			glm::vec3 scaleDelta = ((*m_PrevTransforms)[i].scale - m_Transforms[i].scale) + 1.0f;
-
-			glm::mat4 deltaMatrix = glm::translate(glm::mat4(1), translationDelta);
-			deltaMatrix = glm::rotate(deltaMatrix, glm::radians(rotationDelta.z), glm::vec3(0, 0, 1));
-			deltaMatrix = glm::rotate(deltaMatrix, glm::radians(rotationDelta.y), glm::vec3(0, 1, 0));
-			deltaMatrix = glm::rotate(deltaMatrix, glm::radians(rotationDelta.x), glm::vec3(1, 0, 0));
-			deltaMatrix = glm::scale(deltaMatrix, scaleDelta);
-
-			m_InverseTransformMatrices[i] = glm::inverse(m_TransformMatrices[i]); // World to object space
-			// World space position -> Object Space position -> Prev object space position -> Prev world space position
-			m_ToPreviousPositionMatrices[i] = m_TransformMatrices[i] * deltaMatrix * m_InverseTransformMatrices[i];
+			state.blasInstances[i].mask = mask;
+			state.masksChanged = true;
 		}
-		else
+
+		const Transform& transform = m_Instances[i].transform;
+		if (state.prevTransforms[i] == transform)
 		{
-			m_ToPreviousPositionMatrices[i] = glm::mat4(1);
+			// Stopped moving, nothing else about the instance changed
+			if (state.moved[i])
+				state.toPreviousPositionMatrices[i] = glm::mat4(1);
+
+			state.moved[i] = false;
+			continue;
 		}
 
-		(*m_PrevTransforms)[i] = m_Transforms[i];
+		state.moved[i] = true;
+		state.movedCount++;
+
+		// Going world and object space conversion
+		state.transformMatrices[i] = transform.GetTransformMatrix(); // Object space to world space
+
+		// Current position to prev position in object space
+		glm::vec3 translationDelta = state.prevTransforms[i].translation - transform.translation;
+		glm::vec3 rotationDelta = state.prevTransforms[i].rotation - transform.rotation;
+		glm::vec3 scaleDelta = (state.prevTransforms[i].scale - transform.scale) + 1.0f;
+
+		glm::mat4 deltaMatrix = glm::translate(glm::mat4(1), translationDelta);
+		deltaMatrix = glm::rotate(deltaMatrix, glm::radians(rotationDelta.z), glm::vec3(0, 0, 1));
+		deltaMatrix = glm::rotate(deltaMatrix, glm::radians(rotationDelta.y), glm::vec3(0, 1, 0));
+		deltaMatrix = glm::rotate(deltaMatrix, glm::radians(rotationDelta.x), glm::vec3(1, 0, 0));
+		deltaMatrix = glm::scale(deltaMatrix, scaleDelta);
+
+		state.inverseTransformMatrices[i] = glm::inverse(state.transformMatrices[i]); // World to object space
+		// World space position -> Object Space position -> Prev object space position -> Prev world space position
+		state.toPreviousPositionMatrices[i] = state.transformMatrices[i] * deltaMatrix * state.inverseTransformMatrices[i];
+
+		state.prevTransforms[i] = transform;
+
+		WriteInstanceTransform(i);
+		state.blasInstances[i].Update(state.bvhPointers[m_Instances[i].blasHandle]);
+	}
+}
 
-		// Write to BLASInstance transform
-		// Convert from column-major to row-major format
-		const float* matrixData = (const float*)glm::value_ptr(m_TransformMatrices[i]);
-		int transformIndex = 0;
-		for (int column = 0; column < 4; column++)
+void TLAS::WriteInstanceTransform(uint32_t index)
+{
+	InstanceState& state = *m_InstanceState;
+
+	// Write to BLASInstance transform
+	// Convert from column-major to row-major format
+	const float* matrixData = (const float*)glm::value_ptr(state.transformMatrices[index]);
+	int transformIndex = 0;
+	for (int column = 0; column < 4; column++)
+	{
+		for (int item = 0; item < 4; item++)
 		{
-			for (int item = 0; item < 4; item++)
-			{
-				int index = column + item * 4;
-				m_BLASInstances[i].transform[transformIndex] = matrixData[index];
-				transformIndex++;
-			}
+			int matrixIndex = column + item * 4;
+			state.blasInstances[index].transform[transformIndex] = matrixData[matrixIndex];
+			transformIndex++;
 		}
 	}
-
 }
 
 void TLAS::Traverse(Ray& ray) const
@@ -104,44 +274,168 @@ void TLAS::Traverse(Ray& ray) const
 	tinybvh::bvhvec3 direction = tinybvh::bvhvec3(ray.direction.x, ray.direction.y, ray.direction.z);
 	float prevClosestHitDistance = ray.hitInfo.distance;
 
-	tinybvh::Ray tinybvhRay = tinybvh::Ray(origin, direction, prevClosestHitDistance);
+	tinybvh::Ray tinybvhRay = tinybvh::Ray(origin, direction, prevClosestHitDistance, ray.mask);
 	int32_t traversalSteps = m_TLAS->Intersect(tinybvhRay);
 
 	// Hit Test
-	HitInfo hitInfo(tinybvhRay.hit.t < prevClosestHitDistance);
+	if (tinybvhRay.hit.t < prevClosestHitDistance)
+		SetHitInfo(ray, tinybvhRay.hit, traversalSteps);
+}
 
-	// Set all intersection data
-	if (hitInfo.hit)
+void TLAS::TraversePacket(Ray* rays) const
+{
+	for (uint32_t i = 0; i < m_BLASList.size(); i++)
 	{
+		if (m_BLASList[i]->GetPacketBVH() == nullptr)
+		{
+			for (uint32_t rayIndex = 0; rayIndex < PacketSize; rayIndex++)
+				Traverse(rays[rayIndex]);
+
+			return;
+		}
+	}
+
+	// Frustum planes through the corner rays, normals pointing outwards. Same construction
+	// as Intersect256Rays, so the TLAS only culls what the BLAS traversal would skip anyway
+	const glm::vec3 origin = rays[0].origin;
+	const glm::vec3 p0 = origin + rays[0].direction;
+	const glm::vec3 p1 = origin + rays[51].direction;
+	const glm::vec3 p2 = origin + rays[204].direction;
+	const glm::vec3 p3 = origin + rays[255].direction;
+	const glm::vec3 planes[4] = {
+		glm::normalize(glm::cross(p0 - origin, p0 - p2)),
+		glm::normalize(glm::cross(p3 - origin, p3 - p1)),
+		glm::normalize(glm::cross(p1 - origin, p1 - p0)),
+		glm::normalize(glm::cross(p2 - origin, p2 - p3))
+	};
+
+	auto outsideFrustum = [&](const tinybvh::bvhvec3& aabbMin, const tinybvh::bvhvec3& aabbMax) {
+		for (const glm::vec3& plane : planes)
+		{
+			// Corner of the box furthest along the inverted plane normal
+			glm::vec3 corner(plane.x < 0.0f ? aabbMax.x : aabbMin.x, plane.y < 0.0f ? aabbMax.y : aabbMin.y, plane.z < 0.0f ? aabbMax.z : aabbMin.z);
+			if (glm::dot(corner - origin, plane) > 0.0f)
+				return true;
+		}
+		return false;
+	};
+
+	tinybvh::Intersection hits[PacketSize];
+	for (uint32_t rayIndex = 0; rayIndex < PacketSize; rayIndex++)
+	{
+		hits[rayIndex] = tinybvh::Intersection();
+		hits[rayIndex].t = rays[rayIndex].hitInfo.distance;
+	}
+
+	// Walk the TLAS with the frustum, every instance it overlaps traces the packet in object space
+	ALIGNED(64) tinybvh::Ray packet[PacketSize];
+	static constexpr uint32_t PacketStackSize = 64;
+	uint32_t stack[PacketStackSize];
+	uint32_t stackPtr = 0;
+	uint32_t nodeIndex = 0;
+	while (true)
+	{
+		const tinybvh::BVH::BVHNode& node = m_TLAS->bvhNode[nodeIndex];
+		if (!outsideFrustum(node.aabbMin, node.aabbMax))
+		{
+			if (!node.isLeaf())
+			{
+				// Nothing is written back before the walk ends, so the packet can start over with single rays
+				if (stackPtr == PacketStackSize)
+				{
+					for (uint32_t rayIndex = 0; rayIndex < PacketSize; rayIndex++)
+						Traverse(rays[rayIndex]);
+
+					return;
+				}
+
+				stack[stackPtr++] = node.leftFirst + 1;
+				nodeIndex = node.leftFirst;
+				continue;
+			}
+
+			for (uint32_t i = 0; i < node.triCount; i++)
+			{
+				uint32_t instanceIndex = m_TLAS->primIdx[node.leftFirst + i];
+				const tinybvh::BLASInstance& instance = m_InstanceState->blasInstances[instanceIndex];
+				if (!(instance.mask & rays[0].mask) || outsideFrustum(instance.aabbMin, instance.aabbMax))
+					continue;
+
+				tinybvh::bvhvec3 objectOrigin = tinybvh::tinybvh_transform_point(tinybvh::bvhvec3(origin.x, origin.y, origin.z), instance.invTransform);
+				for (uint32_t rayIndex = 0; rayIndex < PacketSize; rayIndex++)
+				{
+					const glm::vec3& direction = rays[rayIndex].direction;
+					tinybvh::Ray& packetRay = packet[rayIndex];
+					packetRay.O = objectOrigin;
+					packetRay.D = tinybvh::tinybvh_transform_vector(tinybvh::bvhvec3(direction.x, direction.y, direction.z), instance.invTransform);
+					packetRay.rD = tinybvh::tinybvh_rcp(packetRay.D);
+					packetRay.instIdx = instanceIndex << (32 - INST_IDX_BITS);
+					packetRay.hit = hits[rayIndex];
+				}
+
+				m_BLASList[instance.blasIdx]->GetPacketBVH()->Intersect256Rays(packet);
+
+				for (uint32_t rayIndex = 0; rayIndex < PacketSize; rayIndex++)
+					hits[rayIndex] = packet[rayIndex].hit;
+			}
+		}
+
+		if (stackPtr == 0)
+			break;
+
+		nodeIndex = stack[--stackPtr];
+	}
+
+	for (uint32_t rayIndex = 0; rayIndex < PacketSize; rayIndex++)
+	{
+		if (hits[rayIndex].t < rays[rayIndex].hitInfo.distance)
+			SetHitInfo(rays[rayIndex], hits[rayIndex], 0);
+	}
+}
+
+void TLAS::SetHitInfo(Ray& ray, const tinybvh::Intersection& hit, int32_t traversalSteps) const
+{
+	HitInfo hitInfo(true);
+
 #if INST_IDX_BITS == 32
-		uint32_t vertexIndex = tinybvhRay.hit.prim;
-		uint32_t instanceIndex = (uint32_t)tinybvhRay.hit.inst;
+	uint32_t vertexIndex = hit.prim;
+	uint32_t instanceIndex = (uint32_t)hit.inst;
 #else
-		uint32_t vertexIndex = tinybvhRay.hit.prim & PRIM_IDX_MASK;
-		uint32_t instanceIndex = (uint32_t)tinybvhRay.hit.prim >> INST_IDX_SHFT;
+	uint32_t vertexIndex = hit.prim & PRIM_IDX_MASK;
+	uint32_t instanceIndex = (uint32_t)hit.prim >> INST_IDX_SHFT;
 #endif
-		int blasIndex = m_BLASInstances[instanceIndex].blasIdx;
-		const std::vector<tinybvh::bvhvec4>& vertices = m_BLASList[blasIndex]->GetVertices();
-
-		// Triangle hit
-		glm::vec3 position0 = glm::vec3(vertices[vertexIndex * 3 + 0].x, vertices[vertexIndex * 3 + 0].y, vertices[vertexIndex * 3 + 0].z);
-		glm::vec3 position1 = glm::vec3(vertices[vertexIndex * 3 + 1].x, vertices[vertexIndex * 3 + 1].y, vertices[vertexIndex * 3 + 1].z);
-		glm::vec3 position2 = glm::vec3(vertices[vertexIndex * 3 + 2].x, vertices[vertexIndex * 3 + 2].y, vertices[vertexIndex * 3 + 2].z);
-
-		glm::mat4 toPreviousPosition = m_ToPreviousPositionMatrices[blasIndex];
-
-		// HitInfo Data
-		hitInfo.distance = tinybvhRay.hit.t;
-		hitInfo.position = ray.origin + ray.direction * tinybvhRay.hit.t;
-		hitInfo.prevPosition = toPreviousPosition * glm::vec4(hitInfo.position, 1.0f);
-		hitInfo.normal = glm::normalize(m_TransformMatrices[blasIndex] * glm::vec4(Utils::TriangleNormal(position0, position1, position2), 0.0f));
-		hitInfo.prevNormal = glm::normalize(toPreviousPosition * glm::vec4(hitInfo.normal, 0.0f));
-		hitInfo.traversalStepsHitBVH = traversalSteps;
-		hitInfo.traversalStepsTotal += ray.hitInfo.traversalStepsTotal + traversalSteps;
-
-		// Set new HitInfo
-		ray.hitInfo = hitInfo;
-	}
+	int blasIndex = m_InstanceState->blasInstances[instanceIndex].blasIdx;
+	const std::vector<tinybvh::bvhvec4>& vertices = m_BLASList[blasIndex]->GetVertices();
+
+	// Triangle hit
+	glm::vec3 position0 = glm::vec3(vertices[vertexIndex * 3 + 0].x, vertices[vertexIndex * 3 + 0].y, vertices[vertexIndex * 3 + 0].z);
+	glm::vec3 position1 = glm::vec3(vertices[vertexIndex * 3 + 1].x, vertices[vertexIndex * 3 + 1].y, vertices[vertexIndex * 3 + 1].z);
+	glm::vec3 position2 = glm::vec3(vertices[vertexIndex * 3 + 2].x, vertices[vertexIndex * 3 + 2].y, vertices[vertexIndex * 3 + 2].z);
+
+	// HitInfo Data
+	hitInfo.distance = hit.t;
+	hitInfo.position = ray.origin + ray.direction * hit.t;
+	hitInfo.normal = glm::normalize(m_InstanceState->transformMatrices[instanceIndex] * glm::vec4(Utils::TriangleNormal(position0, position1, position2), 0.0f));
+	hitInfo.instanceIndex = instanceIndex;
+	hitInfo.traversalStepsHitBVH = traversalSteps;
+	hitInfo.traversalStepsTotal = ray.hitInfo.traversalStepsTotal + traversalSteps;
+
+	// Set new HitInfo
+	ray.hitInfo = hitInfo;
+}
+
+void TLAS::GetPrevHit(const HitInfo& hitInfo, glm::vec3& prevPosition, glm::vec3& prevNormal) const
+{
+	const glm::mat4& toPreviousPosition = m_InstanceState->toPreviousPositionMatrices[hitInfo.instanceIndex];
+	prevPosition = toPreviousPosition * glm::vec4(hitInfo.position, 1.0f);
+	prevNormal = glm::normalize(toPreviousPosition * glm::vec4(hitInfo.normal, 0.0f));
+}
+
+void TLAS::GetBounds(glm::vec3& aabbMin, glm::vec3& aabbMax) const
+{
+	const tinybvh::BVH::BVHNode& rootNode = m_TLAS->bvhNode[0];
+	aabbMin = glm::vec3(rootNode.aabbMin.x, rootNode.aabbMin.y, rootNode.aabbMin.z);
+	aabbMax = glm::vec3(rootNode.aabbMax.x, rootNode.aabbMax.y, rootNode.aabbMax.z);
 }
 
 bool TLAS::IsOccluded(const Ray& ray) const
@@ -150,5 +444,108 @@ bool TLAS::IsOccluded(const Ray& ray) const
 	tinybvh::bvhvec3 direction = tinybvh::bvhvec3(ray.direction.x, ray.direction.y, ray.direction.z);
 	float maxDistance = ray.hitInfo.distance;
 
-	return m_TLAS->IsOccluded(tinybvh::Ray(origin, direction, maxDistance));
-}
\ No newline at end of file
+	return m_TLAS->IsOccluded(tinybvh::Ray(origin, direction, maxDistance, ray.mask));
+}
+
+void TLAS::IsOccluded(const Ray* rays, uint32_t rayCount, uint8_t* occluded) const
+{
+	for (uint32_t streamStart = 0; streamStart < rayCount; streamStart += StreamSize)
+		IsOccludedStream(rays + streamStart, std::min(StreamSize, rayCount - streamStart), occluded + streamStart);
+}
+
+void TLAS::IsOccludedStream(const Ray* rays, uint32_t rayCount, uint8_t* occluded) const
+{
+	static constexpr uint32_t StackSize = 64;
+
+	struct StreamEntry
+	{
+		uint32_t nodeIndex;
+		uint32_t listStart; // Rays of the parent node, the node itself filters them
+		uint32_t listCount;
+	};
+
+	tinybvh::bvhvec3 origins[StreamSize];
+	tinybvh::bvhvec3 reciprocalDirections[StreamSize];
+	for (uint32_t rayIndex = 0; rayIndex < rayCount; rayIndex++)
+	{
+		const Ray& ray = rays[rayIndex];
+		origins[rayIndex] = tinybvh::bvhvec3(ray.origin.x, ray.origin.y, ray.origin.z);
+		reciprocalDirections[rayIndex] = tinybvh::tinybvh_rcp(tinybvh::bvhvec3(ray.direction.x, ray.direction.y, ray.direction.z));
+		occluded[rayIndex] = 0;
+	}
+
+	auto intersectsBox = [&](uint32_t rayIndex, const tinybvh::bvhvec3& aabbMin, const tinybvh::bvhvec3& aabbMax) {
+		const tinybvh::bvhvec3& origin = origins[rayIndex];
+		const tinybvh::bvhvec3& reciprocalDirection = reciprocalDirections[rayIndex];
+		float tx1 = (aabbMin.x - origin.x) * reciprocalDirection.x, tx2 = (aabbMax.x - origin.x) * reciprocalDirection.x;
+		float ty1 = (aabbMin.y - origin.y) * reciprocalDirection.y, ty2 = (aabbMax.y - origin.y) * reciprocalDirection.y;
+		float tz1 = (aabbMin.z - origin.z) * reciprocalDirection.z, tz2 = (aabbMax.z - origin.z) * reciprocalDirection.z;
+		float tMin = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::min(tz1, tz2));
+		float tMax = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2));
+		return tMax >= tMin && tMin < rays[rayIndex].hitInfo.distance && tMax >= 0.0f;
+	};
+
+	// Ray lists of the nodes on the current path, a node's list is written after its parent's
+	uint8_t rayLists[(StackSize + 2) * StreamSize];
+	StreamEntry stack[StackSize];
+	uint32_t stackPtr = 0;
+
+	for (uint32_t rayIndex = 0; rayIndex < rayCount; rayIndex++)
+		rayLists[rayIndex] = rayIndex;
+
+	stack[stackPtr++] = { 0, 0, rayCount };
+	while (stackPtr > 0)
+	{
+		const StreamEntry entry = stack[--stackPtr];
+		const tinybvh::BVH::BVHNode& node = m_TLAS->bvhNode[entry.nodeIndex];
+
+		// Lists past the parent's belong to subtrees that are done
+		uint32_t listStart = entry.listStart + entry.listCount;
+		uint32_t listCount = 0;
+		for (uint32_t i = entry.listStart; i < entry.listStart + entry.listCount; i++)
+		{
+			uint32_t rayIndex = rayLists[i];
+			if (!occluded[rayIndex] && intersectsBox(rayIndex, node.aabbMin, node.aabbMax))
+				rayLists[listStart + listCount++] = rayIndex;
+		}
+
+		if (listCount == 0)
+			continue;
+
+		if (!node.isLeaf())
+		{
+			if (stackPtr + 2 > StackSize)
+			{
+				for (uint32_t i = listStart; i < listStart + listCount; i++)
+					occluded[rayLists[i]] = IsOccluded(rays[rayLists[i]]) ? 1 : 0;
+
+				continue;
+			}
+
+			stack[stackPtr++] = { node.leftFirst + 1, listStart, listCount };
+			stack[stackPtr++] = { node.leftFirst, listStart, listCount };
+			continue;
+		}
+
+		for (uint32_t i = 0; i < node.triCount; i++)
+		{
+			const tinybvh::BLASInstance& instance = m_InstanceState->blasInstances[m_TLAS->primIdx[node.leftFirst + i]];
+			const BLAS& blas = *m_BLASList[instance.blasIdx];
+			for (uint32_t j = listStart; j < listStart + listCount; j++)
+			{
+				uint32_t rayIndex = rayLists[j];
+				const Ray& ray = rays[rayIndex];
+				if (occluded[rayIndex] || !(instance.mask & ray.mask) || !intersectsBox(rayIndex, instance.aabbMin, instance.aabbMax))
+					continue;
+
+				// Object space ray, the direction isn't normalized so distances stay in world units
+				tinybvh::Ray objectRay;
+				objectRay.O = tinybvh::tinybvh_transform_point(origins[rayIndex], instance.invTransform);
+				objectRay.D = tinybvh::tinybvh_transform_vector(tinybvh::bvhvec3(ray.direction.x, ray.direction.y, ray.direction.z), instance.invTransform);
+				objectRay.rD = tinybvh::tinybvh_rcp(objectRay.D);
+				objectRay.hit.t = ray.hitInfo.distance;
+				occluded[rayIndex] = blas.IsOccluded(objectRay) ? 1 : 0;
+			}
+		}
+	}
+}
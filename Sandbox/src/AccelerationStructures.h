@@ -5,9 +5,17 @@
 #include "Include.h"
 #include "Ray.h"
 #include "Transform.h"
+#include "BLASCache.h"
 
 class BLAS
 {
+public:
+	// Fast is a binned build, High a spatial split build that costs several times as long but traces faster
+	enum class BuildQuality
+	{
+		Fast,
+		High
+	};
 private:
 #if defined(__AVX2__)
 	tinybvh::BVH8_CPU m_BVH;
@@ -32,52 +40,147 @@ public:
 
 	~BLAS() = default;
 
-	void SetObject(std::vector<tinybvh::bvhvec4>& vertices);
+	void SetObject(std::vector<tinybvh::bvhvec4>& vertices, BuildQuality quality = BuildQuality::High);
+	// Loads the BVH from the cache when it has an entry for the vertices, builds it otherwise.
+	// Only high quality builds are stored, a cached one is used for fast requests as well.
+	void SetObject(std::vector<tinybvh::bvhvec4>& vertices, const BLASCache& cache, BuildQuality quality = BuildQuality::High);
+	// Offline step, the optimized BVH is stored in the cache and used from the next load on
+	bool OptimizeCacheEntry(const BLASCache& cache, uint32_t iterations) const { return cache.Optimize(m_Vertices, iterations); }
 	void Refit() { m_BVH.Refit(); }
+	bool IsOccluded(const tinybvh::Ray& ray) const { return m_BVH.IsOccluded(ray); }
 
 	tinybvh::BVHBase* GetBVHPointer() { return &m_BVH; }
+
+	// Binary BVH the wide layouts are converted from, used for packet traversal
+	const tinybvh::BVH* GetPacketBVH() const
+	{
+#if defined(__AVX2__)
+		const tinybvh::BVH& bvh = m_BVH.bvh8.bvh;
+#elif defined(__AVX__)
+		const tinybvh::BVH& bvh = m_BVH.bvh;
+#else
+		const tinybvh::BVH& bvh = m_BVH.bvh4.bvh;
+#endif
+		return bvh.usedNodes > 0 ? &bvh : nullptr;
+	}
 protected:
 	friend class TLAS;
 	const std::vector<tinybvh::bvhvec4>& GetVertices() { return m_Vertices; }
+private:
+	void TakeVertices(std::vector<tinybvh::bvhvec4>& vertices);
+	tinybvh::BVH& GetBinaryBVH();
+	void BuildBinaryBVH(BuildQuality quality);
+	void ConvertBinaryBVH();
 };
 
 class TLAS
 {
+public:
+	// Packets are 16x16 rays laid out as 4x4 blocks of 4x4 rays, as expected by tinybvh.
+	// Packet rows run bottom to top, which gives the frustum planes tinybvh derives from
+	// the corner rays outward facing normals with this camera.
+	static constexpr uint32_t PacketSize = 256;
+	static constexpr uint32_t PacketWidth = 16;
+	// Occlusion streams walk the TLAS with up to this many rays at once
+	static constexpr uint32_t StreamSize = 64;
+
+	static uint32_t GetPacketIndex(uint32_t x, uint32_t y)
+	{
+		uint32_t packetY = PacketWidth - 1 - y;
+		return ((packetY >> 2) * 4 + (x >> 2)) * 16 + (packetY & 3) * 4 + (x & 3);
+	}
+
+	// One placement of a BLAS, any number of instances share the same BLAS data
+	struct Instance
+	{
+		uint32_t blasHandle;
+		Transform transform;
+		uint32_t mask; // See RayMask
+
+		bool operator==(const Instance& other) const { return blasHandle == other.blasHandle && transform == other.transform && mask == other.mask; }
+		bool operator!=(const Instance& other) const { return !(*this == other); }
+	};
 private:
+	// Everything derived from the instances, only the instances that moved since the previous update
+	// are updated. BVH pointers are per BLAS, the rest per instance. Shared between copies like the BVH itself, tinybvh keeps pointers into the instance
+	// and BVH pointer arrays, so they must outlive copies.
+	struct InstanceState
+	{
+		std::vector<tinybvh::BLASInstance> blasInstances;
+		std::vector<tinybvh::BVHBase*> bvhPointers;
+		std::vector<Transform> prevTransforms;
+		std::vector<glm::mat4> transformMatrices;
+		std::vector<glm::mat4> inverseTransformMatrices;
+		std::vector<glm::mat4> toPreviousPositionMatrices;
+		std::vector<uint8_t> moved; // Moved in the previous update, its reprojection is reset once it stops
+		uint32_t movedCount; // Since the previous update
+		bool masksChanged; // Since the previous update
+		bool needsBuild; // Instances or BLASes were added since the last build
+		float buildSurfaceArea;
+
+		InstanceState() :
+			movedCount{ 0 }, masksChanged{ false }, needsBuild{ true }, buildSurfaceArea{ 0.0f }
+		{}
+	};
+
+	// A refit is used while at most this fraction of the instances moved and the bounds stay tight
+	static constexpr float RefitMaxMovedRatio = 0.25f;
+	static constexpr float RebuildSurfaceAreaRatio = 2.0f;
+
 	// BVHs
 	std::shared_ptr<tinybvh::BVH> m_TLAS;
-	std::vector<std::shared_ptr<BLAS>> m_BLASList;
-	std::vector<tinybvh::BLASInstance> m_BLASInstances;
-	std::vector<tinybvh::BVHBase*> m_BVHPointers;
+	std::vector<std::shared_ptr<BLAS>> m_BLASList; // Indexed by BLAS handle
+	std::shared_ptr<InstanceState> m_InstanceState;
 	
 	// UI
-	uint32_t m_TriangleCount;
-
-	// Transforms & Reprojection
-	// m_PrevTransforms is shared pointer to prevent loss of information of prev frames on copy
-	std::vector<Transform> m_Transforms;
-	std::shared_ptr<std::vector<Transform>> m_PrevTransforms; 
-	std::vector<glm::mat4> m_TransformMatrices;
-	std::vector<glm::mat4> m_InverseTransformMatrices;
-	std::vector<glm::mat4> m_ToPreviousPositionMatrices;
+	uint32_t m_TriangleCount; // Summed over the instances
+
+	std::vector<Instance> m_Instances;
 public:
 	TLAS() :
-		m_TLAS{ std::make_shared<tinybvh::BVH>() }, m_PrevTransforms{ std::make_shared<std::vector<Transform>>() },
-		m_Transforms{ std::vector<Transform>() }, m_TriangleCount{ 0 }
+		m_TLAS{ std::make_shared<tinybvh::BVH>() }, m_InstanceState{ std::make_shared<InstanceState>() },
+		m_TriangleCount{ 0 }, m_Instances{ std::vector<Instance>() }
 	{}
 
 	~TLAS() = default;
 
 	void Build();
-	uint32_t AddBLAS(const std::shared_ptr<BLAS>& blas, const Transform& transform);
+	// Updates the transforms, then leaves the BVH as is when nothing moved, refits it when a few
+	// instances moved and rebuilds it when many did or the refit loosened the bounds too much
+	void Update();
+	// Returns the handle instances refer to the BLAS by, the BLAS isn't part of the scene until it has an instance
+	uint32_t AddBLAS(const std::shared_ptr<BLAS>& blas);
+	// Returns the instance index
+	uint32_t AddInstance(uint32_t blasHandle, const Transform& transform, uint32_t mask = RayMaskAll);
 
 	void Traverse(Ray& ray) const;
+	// All rays must share their origin and mask, falls back to single rays when a BLAS can't trace packets
+	// or the TLAS is too deep for the stack. Packet hits don't report traversal steps.
+	void TraversePacket(Ray* rays) const;
 	bool IsOccluded(const Ray& ray) const;
+	// Walks the TLAS once per stream of rays, every node is tested against all rays still active
+	// in its parent. The instances a ray reaches trace it with the BLAS's SIMD occlusion query.
+	void IsOccluded(const Ray* rays, uint32_t rayCount, uint8_t* occluded) const;
 
 	void UpdateTransform();
+	bool InstancesChanged() const { return m_InstanceState->movedCount > 0 || m_InstanceState->masksChanged; }
+	// Where the hit surface point was in the previous frame, following its instance's motion
+	void GetPrevHit(const HitInfo& hitInfo, glm::vec3& prevPosition, glm::vec3& prevNormal) const;
+
+	void GetBounds(glm::vec3& aabbMin, glm::vec3& aabbMax) const;
 
 	uint32_t GetTriangleCount() { return m_TriangleCount; }
-	uint32_t GetObjectCount() const { return m_BLASList.size(); }
-	Transform& GetTransformRef(uint32_t index) { return m_Transforms[index]; }
-	std::shared_ptr<BLAS> GetBLAS(uint32_t index) const { return m_BLASList[index]; }
+	uint32_t GetInstanceCount() const { return m_Instances.size(); }
+	uint32_t GetBLASCount() const { return m_BLASList.size(); }
+	Transform& GetTransformRef(uint32_t index) { return m_Instances[index].transform; }
+	uint32_t& GetMaskRef(uint32_t index) { return m_Instances[index].mask; }
+	uint32_t GetBLASHandle(uint32_t index) const { return m_Instances[index].blasHandle; }
+	const std::vector<Instance>& GetInstances() const { return m_Instances; }
+	std::shared_ptr<BLAS> GetBLAS(uint32_t blasHandle) const { return m_BLASList[blasHandle]; }
+private:
+	void SetHitInfo(Ray& ray, const tinybvh::Intersection& hit, int32_t traversalSteps) const;
+	void IsOccludedStream(const Ray* rays, uint32_t rayCount, uint8_t* occluded) const;
+	void WriteInstanceTransform(uint32_t index);
+	void Refit();
+	float CalcSurfaceArea() const;
 };
\ No newline at end of file
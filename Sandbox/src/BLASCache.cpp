@@ -0,0 +1,101 @@
+#include "BLASCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+
+bool BLASCache::Load(tinybvh::BVH& bvh, const std::vector<tinybvh::bvhvec4>& vertices) const
+{
+	return LoadEntry(bvh, GetEntryPath(vertices, true), vertices) || LoadEntry(bvh, GetEntryPath(vertices, false), vertices);
+}
+
+bool BLASCache::LoadEntry(tinybvh::BVH& bvh, const std::string& path, const std::vector<tinybvh::bvhvec4>& vertices)
+{
+	// tinybvh overwrites the BVH with the file contents before its last checks, so the entry is loaded
+	// into a temporary. Load fails before it allocates anything, the pointers it read aren't owned.
+	tinybvh::BVH loaded;
+	if (!loaded.Load(path.c_str(), vertices.data(), vertices.size() / 3))
+	{
+		loaded.bvhNode = nullptr;
+		loaded.primIdx = nullptr;
+		loaded.fragment = nullptr;
+		loaded.context = tinybvh::BVHContext();
+		return false;
+	}
+
+	// The BVH has no move, but Save and Load treat it as plain bytes as well. Swapping hands the loaded
+	// arrays to the BVH and its previous ones to the temporary, which frees them.
+	alignas(tinybvh::BVH) unsigned char bytes[sizeof(tinybvh::BVH)];
+	std::memcpy(bytes, &bvh, sizeof(tinybvh::BVH));
+	std::memcpy(&bvh, &loaded, sizeof(tinybvh::BVH));
+	std::memcpy(&loaded, bytes, sizeof(tinybvh::BVH));
+	return true;
+}
+
+void BLASCache::Store(tinybvh::BVH& bvh, const std::vector<tinybvh::bvhvec4>& vertices, bool optimized) const
+{
+	std::error_code error;
+	std::filesystem::create_directories(m_Directory, error);
+	if (error)
+	{
+		std::cout << "Error creating BLAS cache directory " << m_Directory << ": " << error.message() << std::endl;
+		return;
+	}
+
+	// Written under a temporary name, a crash mid write must not leave a truncated entry.
+	// The name is per thread, parallel loads of the same mesh store the same entry at once.
+	std::string path = GetEntryPath(vertices, optimized);
+	std::string temporaryPath = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	bvh.Save(temporaryPath.c_str());
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error)
+	{
+		std::cout << "Error storing BLAS cache entry " << path << ": " << error.message() << std::endl;
+		std::filesystem::remove(temporaryPath, error);
+	}
+}
+
+bool BLASCache::Optimize(const std::vector<tinybvh::bvhvec4>& vertices, uint32_t iterations) const
+{
+	tinybvh::BVH bvh;
+	if (!LoadEntry(bvh, GetEntryPath(vertices, false), vertices))
+		return false;
+
+	// Reinsertion can't always improve on a spatial split build, only keep a better tree
+	float cost = bvh.SAHCost();
+	bvh.Optimize(iterations);
+	if (bvh.SAHCost() >= cost)
+		return false;
+
+	Store(bvh, vertices, true);
+	return true;
+}
+
+std::string BLASCache::GetEntryPath(const std::vector<tinybvh::bvhvec4>& vertices, bool optimized) const
+{
+	std::stringstream fileName;
+	fileName << std::hex << std::setw(16) << std::setfill('0') << HashVertices(vertices) << std::dec;
+	fileName << "_" << vertices.size() / 3 << (optimized ? "_hq_optimized" : "_hq");
+	fileName << "_v" << TINY_BVH_VERSION_MAJOR << "." << TINY_BVH_VERSION_MINOR << "." << TINY_BVH_VERSION_SUB << ".bvh";
+	return (std::filesystem::path(m_Directory) / fileName.str()).string();
+}
+
+uint64_t BLASCache::HashVertices(const std::vector<tinybvh::bvhvec4>& vertices)
+{
+	// FNV-1a style xor and multiply over 64 bit words, meshes reach gigabytes so bytewise hashing is too slow.
+	// A word only reaches the higher bits through the multiply, the xorshift folds them back down.
+	const uint64_t* words = reinterpret_cast<const uint64_t*>(vertices.data());
+	size_t wordCount = vertices.size() * sizeof(tinybvh::bvhvec4) / sizeof(uint64_t);
+
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < wordCount; i++)
+	{
+		hash ^= words[i];
+		hash *= 1099511628211ull;
+		hash ^= hash >> 32;
+	}
+
+	return hash;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "tiny_bvh.h"
+
+#include "Include.h"
+
+// On-disk cache of BLAS BVHs, so a mesh only pays for its SBVH build once. Entries are the binary
+// BVH the wide layouts are converted from, keyed by a hash of the vertex data, the build mode and
+// the tinybvh version. An optimized entry is preferred over the plain one of the same mesh.
+class BLASCache
+{
+private:
+	std::string m_Directory;
+public:
+	BLASCache(const std::string& directory) :
+		m_Directory{ directory }
+	{}
+
+	~BLASCache() = default;
+
+	// Returns false when there is no usable entry for the vertices, the BVH is left untouched then
+	bool Load(tinybvh::BVH& bvh, const std::vector<tinybvh::bvhvec4>& vertices) const;
+	void Store(tinybvh::BVH& bvh, const std::vector<tinybvh::bvhvec4>& vertices, bool optimized) const;
+
+	// Offline step, runs the optimizer on the cached BVH of the vertices and stores the result as
+	// the optimized entry when it lowered the SAH cost. Takes minutes on large meshes, loads use it from then on.
+	bool Optimize(const std::vector<tinybvh::bvhvec4>& vertices, uint32_t iterations) const;
+private:
+	static bool LoadEntry(tinybvh::BVH& bvh, const std::string& path, const std::vector<tinybvh::bvhvec4>& vertices);
+	std::string GetEntryPath(const std::vector<tinybvh::bvhvec4>& vertices, bool optimized) const;
+	static uint64_t HashVertices(const std::vector<tinybvh::bvhvec4>& vertices);
+};
@@ -2,10 +2,10 @@
 
 Ray Camera::GetRay(uint32_t x, uint32_t y) const
 {
-	return Ray(position, GetDirection(x, y));
+	return Ray(position, GetDirection(x, y), std::numeric_limits<float>().infinity(), RayMaskPrimary);
 }
 
-glm::i32vec2 Camera::WorldSpaceToScreenSpace(const glm::vec3& worldPosition, uint32_t& seed) const
+glm::vec2 Camera::WorldSpaceToScreenSpace(const glm::vec3& worldPosition) const
 {
 	glm::vec3 cameraToPosition = worldPosition - position;
 
@@ -17,10 +17,7 @@ glm::i32vec2 Camera::WorldSpaceToScreenSpace(const glm::vec3& worldPosition, uin
 	float x = m_Width * leftDistance / (leftDistance + rightDistance);
 	float y = m_Height * topDistance / (topDistance + bottomDistance);
 
-	float xOffset = Utils::RandomFloat(seed) - 0.5f;
-	float yOffset = Utils::RandomFloat(seed) - 0.5f;
-
-	return glm::i32vec2(x + xOffset, y + yOffset);
+	return glm::vec2(x, y);
 }
 
 void Camera::SetResolution(uint32_t width, uint32_t height)
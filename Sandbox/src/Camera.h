@@ -60,7 +60,8 @@ public:
 	~Camera() = default;
 
 	Ray GetRay(uint32_t x, uint32_t y) const;
-	glm::i32vec2 WorldSpaceToScreenSpace(const glm::vec3& worldPosition, uint32_t& seed) const;
+	// Continuous screen position in pixels, pixel centers lie at .5
+	glm::vec2 WorldSpaceToScreenSpace(const glm::vec3& worldPosition) const;
 
 	void SetResolution(uint32_t width, uint32_t height);
 
@@ -0,0 +1,415 @@
+#include "Denoiser.h"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// B3 spline a-trous kernel
+static const float KernelWeights[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+static inline float Luminance(float r, float g, float b)
+{
+	return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+// exp(-x) for x >= 0 through a polynomial fit of 2^f, identical to the AVX2 path
+static inline float FastNegativeExp(float x)
+{
+	float t = -std::min(x, 80.0f) * 1.442695041f;
+	float n = std::floor(t);
+	float f = t - n;
+	float p = 1.0f + f * (0.693147182f + f * (0.240226507f + f * (0.0555041087f + f * 0.00961812911f)));
+
+	int32_t exponentBits = (static_cast<int32_t>(n) + 127) << 23;
+	float scale;
+	std::memcpy(&scale, &exponentBits, sizeof(float));
+	return p * scale;
+}
+
+// Normal similarity raised to the power 128
+static inline float NormalWeight(float similarity)
+{
+	float weight = std::max(similarity, 0.0f);
+	for (uint32_t i = 0; i < 7; i++)
+		weight *= weight;
+
+	return weight;
+}
+
+#if defined(__AVX2__)
+static inline __m256 FastNegativeExpAVX2(__m256 x)
+{
+	__m256 t = _mm256_mul_ps(_mm256_min_ps(x, _mm256_set1_ps(80.0f)), _mm256_set1_ps(-1.442695041f));
+	__m256 n = _mm256_floor_ps(t);
+	__m256 f = _mm256_sub_ps(t, n);
+
+	__m256 p = _mm256_add_ps(_mm256_mul_ps(f, _mm256_set1_ps(0.00961812911f)), _mm256_set1_ps(0.0555041087f));
+	p = _mm256_add_ps(_mm256_mul_ps(f, p), _mm256_set1_ps(0.240226507f));
+	p = _mm256_add_ps(_mm256_mul_ps(f, p), _mm256_set1_ps(0.693147182f));
+	p = _mm256_add_ps(_mm256_mul_ps(f, p), _mm256_set1_ps(1.0f));
+
+	__m256i exponentBits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+	return _mm256_mul_ps(p, _mm256_castsi256_ps(exponentBits));
+}
+
+static inline __m256 LuminanceAVX2(__m256 r, __m256 g, __m256 b)
+{
+	__m256 luminance = _mm256_mul_ps(r, _mm256_set1_ps(0.2126f));
+	luminance = _mm256_add_ps(luminance, _mm256_mul_ps(g, _mm256_set1_ps(0.7152f)));
+	return _mm256_add_ps(luminance, _mm256_mul_ps(b, _mm256_set1_ps(0.0722f)));
+}
+
+static inline __m256 AbsAVX2(__m256 value)
+{
+	return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), value);
+}
+#endif
+
+void Denoiser::BeginFrame(uint32_t width, uint32_t height, uint32_t frameIndex, const FilterSettings& filterSettings, bool validHistory)
+{
+	m_FilterSettings = filterSettings;
+	m_ValidHistory &= validHistory && frameIndex == m_LastFrameIndex + 1;
+	m_FrameIndex = frameIndex;
+
+	m_PrevWidth = m_Width;
+	m_PrevHeight = m_Height;
+	m_Width = width;
+	m_Height = height;
+
+	// History buffers only grow so the previous history survives a smaller resolution
+	uint32_t pixelCount = width * height;
+	if (m_History[0].size() < pixelCount)
+	{
+		m_History[0].resize(pixelCount);
+		m_History[1].resize(pixelCount);
+	}
+
+	m_Depth.resize(pixelCount);
+	m_DepthGradient.resize(pixelCount);
+	m_NormalX.resize(pixelCount);
+	m_NormalY.resize(pixelCount);
+	m_NormalZ.resize(pixelCount);
+	m_Planes[0].Resize(pixelCount);
+	m_Planes[1].Resize(pixelCount);
+}
+
+void Denoiser::EndFrame()
+{
+	m_CurrentHistory = 1 - m_CurrentHistory;
+	m_ValidHistory = true;
+	m_LastFrameIndex = m_FrameIndex;
+}
+
+void Denoiser::AccumulatePixel(const glm::i32vec2 pixel, const glm::vec4& radiance, const HitInfo& hitInfo, const glm::vec2& motionVector, const glm::vec3& prevPosition, const glm::vec3& prevNormal)
+{
+	uint32_t index = pixel.x + pixel.y * m_Width;
+	HistoryPixel& history = m_History[m_CurrentHistory][index];
+	ColorPlanes& planes = m_Planes[0];
+
+	planes.r[index] = radiance.r;
+	planes.g[index] = radiance.g;
+	planes.b[index] = radiance.b;
+	planes.variance[index] = 0.0f;
+
+	if (!hitInfo.hit)
+	{
+		history = HistoryPixel();
+		m_Depth[index] = -1.0f;
+		m_NormalX[index] = 0.0f;
+		m_NormalY[index] = 0.0f;
+		m_NormalZ[index] = 0.0f;
+		return;
+	}
+
+	m_Depth[index] = hitInfo.distance;
+	m_NormalX[index] = hitInfo.normal.x;
+	m_NormalY[index] = hitInfo.normal.y;
+	m_NormalZ[index] = hitInfo.normal.z;
+
+	// Continue the history of the previous pixel if it saw the same surface
+	HistoryPixel prevHistory;
+	glm::i32vec2 prevPixel = glm::i32vec2(glm::floor(glm::vec2(pixel) + 0.5f + motionVector));
+	bool withinFrame = prevPixel.x >= 0 && prevPixel.y >= 0 && prevPixel.x < static_cast<int32_t>(m_PrevWidth) && prevPixel.y < static_cast<int32_t>(m_PrevHeight);
+	if (m_ValidHistory && withinFrame)
+	{
+		const HistoryPixel& candidate = m_History[1 - m_CurrentHistory][prevPixel.x + prevPixel.y * m_PrevWidth];
+		bool sameSurface = candidate.length > 0.0f && glm::length(candidate.position - prevPosition) < HistoryMaxDistance * hitInfo.distance &&
+			glm::dot(candidate.normal, prevNormal) > HistoryMinNormalSimilarity;
+
+		if (sameSurface)
+			prevHistory = candidate;
+	}
+
+	float luminance = Luminance(radiance.r, radiance.g, radiance.b);
+	history.length = std::min(prevHistory.length + 1.0f, MaxHistoryLength);
+	float alpha = std::max(1.0f / history.length, m_FilterSettings.HistoryAlpha);
+
+	history.color = glm::mix(prevHistory.color, glm::vec3(radiance), alpha);
+	history.moments = glm::mix(prevHistory.moments, glm::vec2(luminance, luminance * luminance), alpha);
+	history.position = hitInfo.position;
+	history.normal = hitInfo.normal;
+
+	planes.r[index] = history.color.r;
+	planes.g[index] = history.color.g;
+	planes.b[index] = history.color.b;
+	planes.variance[index] = std::max(history.moments.y - history.moments.x * history.moments.x, 0.0f);
+}
+
+void Denoiser::EstimateVariance(uint32_t yMin, uint32_t yMax)
+{
+	ColorPlanes& planes = m_Planes[0];
+	const std::vector<HistoryPixel>& historyBuffer = m_History[m_CurrentHistory];
+	int32_t width = m_Width;
+	int32_t height = m_Height;
+
+	auto depthDifference = [&](int32_t index, int32_t neighbourIndex) {
+		float neighbourDepth = m_Depth[neighbourIndex];
+		return neighbourDepth < 0.0f ? std::numeric_limits<float>::infinity() : std::abs(m_Depth[index] - neighbourDepth);
+	};
+
+	for (int32_t y = yMin; y < static_cast<int32_t>(yMax); y++)
+	{
+		for (int32_t x = 0; x < width; x++)
+		{
+			int32_t index = x + y * width;
+			float depth = m_Depth[index];
+			if (depth < 0.0f)
+			{
+				m_DepthGradient[index] = 0.0f;
+				continue;
+			}
+
+			// The smaller one-sided difference per axis, so depth edges don't widen the gradient
+			float infinity = std::numeric_limits<float>::infinity();
+			float gradientX = std::min(x > 0 ? depthDifference(index, index - 1) : infinity, x < width - 1 ? depthDifference(index, index + 1) : infinity);
+			float gradientY = std::min(y > 0 ? depthDifference(index, index - width) : infinity, y < height - 1 ? depthDifference(index, index + width) : infinity);
+			gradientX = gradientX == infinity ? 0.0f : gradientX;
+			gradientY = gradientY == infinity ? 0.0f : gradientY;
+			m_DepthGradient[index] = std::max(gradientX, gradientY);
+
+			if (historyBuffer[index].length >= SpatialVarianceHistoryLength)
+				continue;
+
+			// Young histories have unreliable moments, estimate them from the surrounding surface
+			float invDepthPhi = 1.0f / (m_FilterSettings.DepthPhi * std::max(m_DepthGradient[index], 0.0001f));
+			float weightTotal = 0.0f;
+			glm::vec2 moments = glm::vec2(0);
+			for (int32_t ny = std::max(y - 2, 0); ny <= std::min(y + 2, height - 1); ny++)
+			{
+				for (int32_t nx = std::max(x - 2, 0); nx <= std::min(x + 2, width - 1); nx++)
+				{
+					int32_t neighbourIndex = nx + ny * width;
+					if (m_Depth[neighbourIndex] < 0.0f)
+						continue;
+
+					float distance = std::sqrt(static_cast<float>((nx - x) * (nx - x) + (ny - y) * (ny - y)));
+					float depthTerm = distance > 0.0f ? std::abs(depth - m_Depth[neighbourIndex]) * invDepthPhi / distance : 0.0f;
+					float similarity = m_NormalX[index] * m_NormalX[neighbourIndex] + m_NormalY[index] * m_NormalY[neighbourIndex] + m_NormalZ[index] * m_NormalZ[neighbourIndex];
+					float weight = NormalWeight(similarity) * FastNegativeExp(depthTerm);
+
+					float luminance = Luminance(planes.r[neighbourIndex], planes.g[neighbourIndex], planes.b[neighbourIndex]);
+					moments += weight * glm::vec2(luminance, luminance * luminance);
+					weightTotal += weight;
+				}
+			}
+
+			moments /= std::max(weightTotal, 0.0001f);
+			// Boosted while the history is short to filter harder
+			float boost = SpatialVarianceHistoryLength / std::max(historyBuffer[index].length, 1.0f);
+			planes.variance[index] = std::max(moments.y - moments.x * moments.x, 0.0f) * boost;
+		}
+	}
+}
+
+void Denoiser::FilterPixel(const ColorPlanes& source, ColorPlanes& destination, int32_t x, int32_t y, int32_t stepSize) const
+{
+	int32_t width = m_Width;
+	int32_t height = m_Height;
+	int32_t index = x + y * width;
+
+	float depth = m_Depth[index];
+	if (depth < 0.0f)
+	{
+		destination.r[index] = source.r[index];
+		destination.g[index] = source.g[index];
+		destination.b[index] = source.b[index];
+		destination.variance[index] = source.variance[index];
+		return;
+	}
+
+	float luminance = Luminance(source.r[index], source.g[index], source.b[index]);
+	float invLuminancePhi = 1.0f / (m_FilterSettings.ColorPhi * std::sqrt(std::max(source.variance[index], 0.0f)) + 0.0001f);
+	float invDepthPhi = 1.0f / (m_FilterSettings.DepthPhi * std::max(m_DepthGradient[index], 0.0001f));
+
+	glm::vec3 colorTotal = glm::vec3(0);
+	float varianceTotal = 0.0f;
+	float weightTotal = 0.0f;
+
+	for (int32_t ty = -2; ty <= 2; ty++)
+	{
+		int32_t sy = y + ty * stepSize;
+		if (sy < 0 || sy >= height)
+			continue;
+
+		for (int32_t tx = -2; tx <= 2; tx++)
+		{
+			int32_t sx = x + tx * stepSize;
+			if (sx < 0 || sx >= width)
+				continue;
+
+			int32_t neighbourIndex = sx + sy * width;
+			float neighbourDepth = m_Depth[neighbourIndex];
+			if (neighbourDepth < 0.0f)
+				continue;
+
+			float tapDistance = std::sqrt(static_cast<float>(tx * tx + ty * ty)) * stepSize;
+			float tapScale = tapDistance > 0.0f ? 1.0f / tapDistance : 0.0f;
+
+			float neighbourLuminance = Luminance(source.r[neighbourIndex], source.g[neighbourIndex], source.b[neighbourIndex]);
+			float luminanceTerm = std::abs(luminance - neighbourLuminance) * invLuminancePhi;
+			float depthTerm = std::abs(depth - neighbourDepth) * invDepthPhi * tapScale;
+			float similarity = m_NormalX[index] * m_NormalX[neighbourIndex] + m_NormalY[index] * m_NormalY[neighbourIndex] + m_NormalZ[index] * m_NormalZ[neighbourIndex];
+
+			float weight = KernelWeights[tx + 2] * KernelWeights[ty + 2] * NormalWeight(similarity) * FastNegativeExp(luminanceTerm + depthTerm);
+			colorTotal += weight * glm::vec3(source.r[neighbourIndex], source.g[neighbourIndex], source.b[neighbourIndex]);
+			varianceTotal += weight * weight * source.variance[neighbourIndex];
+			weightTotal += weight;
+		}
+	}
+
+	// The center tap always contributes, its weight is the kernel weight
+	destination.r[index] = colorTotal.r / weightTotal;
+	destination.g[index] = colorTotal.g / weightTotal;
+	destination.b[index] = colorTotal.b / weightTotal;
+	destination.variance[index] = varianceTotal / (weightTotal * weightTotal);
+}
+
+void Denoiser::FilterRows(uint32_t iteration, uint32_t yMin, uint32_t yMax)
+{
+	const ColorPlanes& source = m_Planes[iteration & 1];
+	ColorPlanes& destination = m_Planes[(iteration + 1) & 1];
+	int32_t width = m_Width;
+	int32_t height = m_Height;
+	int32_t stepSize = 1 << iteration;
+	int32_t reach = 2 * stepSize;
+
+	for (int32_t y = yMin; y < static_cast<int32_t>(yMax); y++)
+	{
+		int32_t x = 0;
+		for (; x < std::min(reach, width); x++)
+			FilterPixel(source, destination, x, y, stepSize);
+
+#if defined(__AVX2__)
+		const __m256 zero = _mm256_setzero_ps();
+
+		// Interior pixels, all horizontal taps of the 8 pixels are within the row
+		for (; x + 8 + reach <= width; x += 8)
+		{
+			int32_t index = x + y * width;
+
+			__m256 depth = _mm256_loadu_ps(&m_Depth[index]);
+			__m256 normalX = _mm256_loadu_ps(&m_NormalX[index]);
+			__m256 normalY = _mm256_loadu_ps(&m_NormalY[index]);
+			__m256 normalZ = _mm256_loadu_ps(&m_NormalZ[index]);
+			__m256 luminance = LuminanceAVX2(_mm256_loadu_ps(&source.r[index]), _mm256_loadu_ps(&source.g[index]), _mm256_loadu_ps(&source.b[index]));
+
+			__m256 variance = _mm256_max_ps(_mm256_loadu_ps(&source.variance[index]), zero);
+			__m256 luminancePhi = _mm256_add_ps(_mm256_mul_ps(_mm256_sqrt_ps(variance), _mm256_set1_ps(m_FilterSettings.ColorPhi)), _mm256_set1_ps(0.0001f));
+			__m256 invLuminancePhi = _mm256_div_ps(_mm256_set1_ps(1.0f), luminancePhi);
+			__m256 depthPhi = _mm256_mul_ps(_mm256_max_ps(_mm256_loadu_ps(&m_DepthGradient[index]), _mm256_set1_ps(0.0001f)), _mm256_set1_ps(m_FilterSettings.DepthPhi));
+			__m256 invDepthPhi = _mm256_div_ps(_mm256_set1_ps(1.0f), depthPhi);
+
+			__m256 redTotal = zero;
+			__m256 greenTotal = zero;
+			__m256 blueTotal = zero;
+			__m256 varianceTotal = zero;
+			__m256 weightTotal = zero;
+
+			for (int32_t ty = -2; ty <= 2; ty++)
+			{
+				int32_t sy = y + ty * stepSize;
+				if (sy < 0 || sy >= height)
+					continue;
+
+				for (int32_t tx = -2; tx <= 2; tx++)
+				{
+					int32_t neighbourIndex = x + tx * stepSize + sy * width;
+
+					float tapDistance = std::sqrt(static_cast<float>(tx * tx + ty * ty)) * stepSize;
+					__m256 tapScale = _mm256_set1_ps(tapDistance > 0.0f ? 1.0f / tapDistance : 0.0f);
+
+					__m256 neighbourDepth = _mm256_loadu_ps(&m_Depth[neighbourIndex]);
+					__m256 neighbourRed = _mm256_loadu_ps(&source.r[neighbourIndex]);
+					__m256 neighbourGreen = _mm256_loadu_ps(&source.g[neighbourIndex]);
+					__m256 neighbourBlue = _mm256_loadu_ps(&source.b[neighbourIndex]);
+					__m256 neighbourLuminance = LuminanceAVX2(neighbourRed, neighbourGreen, neighbourBlue);
+
+					__m256 luminanceTerm = _mm256_mul_ps(AbsAVX2(_mm256_sub_ps(luminance, neighbourLuminance)), invLuminancePhi);
+					__m256 depthTerm = _mm256_mul_ps(_mm256_mul_ps(AbsAVX2(_mm256_sub_ps(depth, neighbourDepth)), invDepthPhi), tapScale);
+
+					__m256 similarity = _mm256_mul_ps(normalX, _mm256_loadu_ps(&m_NormalX[neighbourIndex]));
+					similarity = _mm256_add_ps(similarity, _mm256_mul_ps(normalY, _mm256_loadu_ps(&m_NormalY[neighbourIndex])));
+					similarity = _mm256_add_ps(similarity, _mm256_mul_ps(normalZ, _mm256_loadu_ps(&m_NormalZ[neighbourIndex])));
+					__m256 normalWeight = _mm256_max_ps(similarity, zero);
+					for (uint32_t i = 0; i < 7; i++)
+						normalWeight = _mm256_mul_ps(normalWeight, normalWeight);
+
+					__m256 weight = _mm256_mul_ps(_mm256_set1_ps(KernelWeights[tx + 2] * KernelWeights[ty + 2]), normalWeight);
+					weight = _mm256_mul_ps(weight, FastNegativeExpAVX2(_mm256_add_ps(luminanceTerm, depthTerm)));
+					// Neighbours without a surface don't contribute
+					weight = _mm256_and_ps(weight, _mm256_cmp_ps(neighbourDepth, zero, _CMP_GE_OQ));
+
+					redTotal = _mm256_add_ps(redTotal, _mm256_mul_ps(weight, neighbourRed));
+					greenTotal = _mm256_add_ps(greenTotal, _mm256_mul_ps(weight, neighbourGreen));
+					blueTotal = _mm256_add_ps(blueTotal, _mm256_mul_ps(weight, neighbourBlue));
+					varianceTotal = _mm256_add_ps(varianceTotal, _mm256_mul_ps(_mm256_mul_ps(weight, weight), _mm256_loadu_ps(&source.variance[neighbourIndex])));
+					weightTotal = _mm256_add_ps(weightTotal, weight);
+				}
+			}
+
+			// Pixels without a surface keep their value, guard their zero weight total
+			__m256 surfaceMask = _mm256_cmp_ps(depth, zero, _CMP_GE_OQ);
+			__m256 invWeightTotal = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_blendv_ps(_mm256_set1_ps(1.0f), weightTotal, surfaceMask));
+
+			__m256 red = _mm256_blendv_ps(_mm256_loadu_ps(&source.r[index]), _mm256_mul_ps(redTotal, invWeightTotal), surfaceMask);
+			__m256 green = _mm256_blendv_ps(_mm256_loadu_ps(&source.g[index]), _mm256_mul_ps(greenTotal, invWeightTotal), surfaceMask);
+			__m256 blue = _mm256_blendv_ps(_mm256_loadu_ps(&source.b[index]), _mm256_mul_ps(blueTotal, invWeightTotal), surfaceMask);
+			__m256 filteredVariance = _mm256_mul_ps(varianceTotal, _mm256_mul_ps(invWeightTotal, invWeightTotal));
+			filteredVariance = _mm256_blendv_ps(_mm256_loadu_ps(&source.variance[index]), filteredVariance, surfaceMask);
+
+			_mm256_storeu_ps(&destination.r[index], red);
+			_mm256_storeu_ps(&destination.g[index], green);
+			_mm256_storeu_ps(&destination.b[index], blue);
+			_mm256_storeu_ps(&destination.variance[index], filteredVariance);
+		}
+#endif
+
+		for (; x < width; x++)
+			FilterPixel(source, destination, x, y, stepSize);
+
+		// The first iteration feeds the history, which keeps the accumulated radiance less noisy
+		if (iteration == 0)
+		{
+			std::vector<HistoryPixel>& historyBuffer = m_History[m_CurrentHistory];
+			for (int32_t index = y * width; index < (y + 1) * width; index++)
+			{
+				if (m_Depth[index] >= 0.0f)
+					historyBuffer[index].color = glm::vec3(destination.r[index], destination.g[index], destination.b[index]);
+			}
+		}
+	}
+}
+
+void Denoiser::WriteOutput(uint32_t iterationCount, glm::vec4* hdrPixels, uint32_t yMin, uint32_t yMax) const
+{
+	const ColorPlanes& planes = m_Planes[iterationCount & 1];
+
+	for (uint32_t index = yMin * m_Width; index < yMax * m_Width; index++)
+	{
+		hdrPixels[index].r = planes.r[index];
+		hdrPixels[index].g = planes.g[index];
+		hdrPixels[index].b = planes.b[index];
+	}
+}
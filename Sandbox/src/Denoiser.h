@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Include.h"
+
+#include "Ray.h"
+
+// Edge-aware a-trous filter in the style of SVGF. Shaded radiance is first accumulated over time
+// along the motion vectors together with its luminance moments, which give a per pixel variance.
+// The filter iterations then blur with growing strides while depth, normals and luminance
+// relative to that variance stop the kernel at edges. All passes work on row ranges so they
+// can be split over threads, the filter iterations use AVX2 on 8 pixels of a row at once.
+class Denoiser
+{
+public:
+	struct FilterSettings
+	{
+		float HistoryAlpha; // Minimum blend factor of the new frame
+		float ColorPhi;
+		float DepthPhi;
+
+		FilterSettings() :
+			HistoryAlpha{ 0.2f }, ColorPhi{ 4.0f }, DepthPhi{ 1.0f }
+		{}
+
+		FilterSettings(float historyAlpha, float colorPhi, float depthPhi) :
+			HistoryAlpha{ historyAlpha }, ColorPhi{ colorPhi }, DepthPhi{ depthPhi }
+		{}
+	};
+private:
+	// Radiance and moments accumulated for a pixel, with the surface they belong to
+	struct HistoryPixel
+	{
+		glm::vec3 color;
+		float length; // Frames accumulated, 0 for pixels without a surface
+		glm::vec2 moments;
+		glm::vec3 position;
+		glm::vec3 normal;
+
+		HistoryPixel() :
+			color{ glm::vec3(0) }, length{ 0.0f }, moments{ glm::vec2(0) }, position{ glm::vec3(0) }, normal{ glm::vec3(0) }
+		{}
+	};
+
+	// Planar layout so 8 neighbouring pixels of a row are one load
+	struct ColorPlanes
+	{
+		std::vector<float> r;
+		std::vector<float> g;
+		std::vector<float> b;
+		std::vector<float> variance;
+
+		void Resize(uint32_t pixelCount) { r.resize(pixelCount); g.resize(pixelCount); b.resize(pixelCount); variance.resize(pixelCount); }
+	};
+
+	static constexpr float MaxHistoryLength = 32.0f;
+	static constexpr float SpatialVarianceHistoryLength = 4.0f; // Shorter histories estimate variance spatially
+	static constexpr float HistoryMaxDistance = 0.01f; // Relative to the hit distance
+	static constexpr float HistoryMinNormalSimilarity = 0.9f;
+
+	uint32_t m_Width;
+	uint32_t m_Height;
+	uint32_t m_PrevWidth; // The previous history is laid out in the previous frame's resolution
+	uint32_t m_PrevHeight;
+	FilterSettings m_FilterSettings;
+
+	std::vector<HistoryPixel> m_History[2];
+	uint32_t m_CurrentHistory;
+	bool m_ValidHistory;
+	uint32_t m_FrameIndex;
+	uint32_t m_LastFrameIndex; // Frame the history was written in
+
+	// Guides, a depth of -1 marks pixels without a surface
+	std::vector<float> m_Depth;
+	std::vector<float> m_DepthGradient;
+	std::vector<float> m_NormalX;
+	std::vector<float> m_NormalY;
+	std::vector<float> m_NormalZ;
+
+	ColorPlanes m_Planes[2]; // Ping-ponged between filter iterations
+public:
+	Denoiser() :
+		m_Width{ 0 }, m_Height{ 0 }, m_PrevWidth{ 0 }, m_PrevHeight{ 0 }, m_CurrentHistory{ 0 }, m_ValidHistory{ false },
+		m_FrameIndex{ 0 }, m_LastFrameIndex{ 0 }
+	{}
+
+	~Denoiser() = default;
+
+	// The history is reprojected across resolution changes, motion vectors point into the previous resolution.
+	// It is dropped when the denoiser didn't run on the previous frame, it would be from long ago.
+	void BeginFrame(uint32_t width, uint32_t height, uint32_t frameIndex, const FilterSettings& filterSettings, bool validHistory);
+	void EndFrame();
+
+	// Passes, each one must have finished for the whole frame before the next one starts
+	void AccumulatePixel(const glm::i32vec2 pixel, const glm::vec4& radiance, const HitInfo& hitInfo, const glm::vec2& motionVector, const glm::vec3& prevPosition, const glm::vec3& prevNormal);
+	void EstimateVariance(uint32_t yMin, uint32_t yMax);
+	void FilterRows(uint32_t iteration, uint32_t yMin, uint32_t yMax);
+	void WriteOutput(uint32_t iterationCount, glm::vec4* hdrPixels, uint32_t yMin, uint32_t yMax) const;
+private:
+	void FilterPixel(const ColorPlanes& source, ColorPlanes& destination, int32_t x, int32_t y, int32_t stepSize) const;
+};
@@ -1,5 +1,10 @@
 #include "GeometryLoader.h"
 
+#include <filesystem>
+#include <numeric>
+
+#include "TaskBatch.h"
+
 bool GeometryLoader::LoadObj(const std::string& filepath, std::vector<tinybvh::bvhvec4>& vertices)
 {
 	vertices.clear();
@@ -14,7 +19,7 @@ bool GeometryLoader::LoadObj(const std::string& filepath, std::vector<tinybvh::b
 		return false;
 	}
 
-	tinyobj::attrib_t attributes = objReader.GetAttrib();
+	const tinyobj::attrib_t& attributes = objReader.GetAttrib();
 	for (int shapeIndex = 0; shapeIndex < objReader.GetShapes().size(); shapeIndex++)
 	{
 		const tinyobj::shape_t& shape = objReader.GetShapes()[shapeIndex];
@@ -33,4 +38,60 @@ bool GeometryLoader::LoadObj(const std::string& filepath, std::vector<tinybvh::b
 	}
 
 	return true;
-}
\ No newline at end of file
+}
+
+std::vector<std::shared_ptr<BLAS>> GeometryLoader::LoadObjects(const std::vector<ObjectLoadRequest>& requests, const BLASCache& cache, uint32_t threadCount, size_t memoryBudget)
+{
+	// Peak memory of a load is the parsed OBJ, the triangle soup and the BVH build, a small multiple of the file size
+	const size_t bytesPerFileByte = 8;
+
+	std::vector<size_t> memoryEstimates(requests.size());
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		std::error_code error;
+		uintmax_t fileSize = std::filesystem::file_size(requests[i].filepath, error);
+		memoryEstimates[i] = error ? 0 : std::min(static_cast<size_t>(fileSize) * bytesPerFileByte, memoryBudget);
+	}
+
+	// Largest first, so the longest build doesn't start last and leave the other threads idle
+	std::vector<size_t> loadOrder(requests.size());
+	std::iota(loadOrder.begin(), loadOrder.end(), 0);
+	std::stable_sort(loadOrder.begin(), loadOrder.end(), [&](size_t a, size_t b) { return memoryEstimates[a] > memoryEstimates[b]; });
+
+	std::mutex memoryMutex;
+	std::condition_variable memoryReleased;
+	size_t memoryInFlight = 0;
+
+	std::vector<std::shared_ptr<BLAS>> objects(requests.size());
+	TaskBatch taskBatch(std::max(1u, std::min(threadCount, static_cast<uint32_t>(requests.size()))));
+	for (size_t index : loadOrder)
+	{
+		taskBatch.EnqueueTask([&, index]()
+			{
+				const ObjectLoadRequest& request = requests[index];
+				size_t memoryEstimate = memoryEstimates[index];
+				{
+					std::unique_lock<std::mutex> lock(memoryMutex);
+					memoryReleased.wait(lock, [&]() { return memoryInFlight + memoryEstimate <= memoryBudget; });
+					memoryInFlight += memoryEstimate;
+				}
+
+				std::vector<tinybvh::bvhvec4> vertices;
+				if (LoadObj(request.filepath, vertices) && !vertices.empty())
+				{
+					std::shared_ptr<BLAS> blas = std::make_shared<BLAS>();
+					blas->SetObject(vertices, cache, request.quality);
+					objects[index] = blas;
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(memoryMutex);
+					memoryInFlight -= memoryEstimate;
+				}
+				memoryReleased.notify_all();
+			});
+	}
+	taskBatch.ExecuteTasks();
+
+	return objects;
+}
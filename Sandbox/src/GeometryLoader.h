@@ -5,8 +5,19 @@
 
 #include "Include.h"
 #include "Transform.h"
+#include "AccelerationStructures.h"
 
 namespace GeometryLoader
 {
+	struct ObjectLoadRequest
+	{
+		std::string filepath;
+		BLAS::BuildQuality quality = BLAS::BuildQuality::High;
+	};
+
 	bool LoadObj(const std::string& filepath, std::vector<tinybvh::bvhvec4>& vertices);
+
+	// Parses the OBJs and builds their BLASes in parallel, the results are in request order and null for files that failed to load.
+	// Objects only start loading while the estimated memory of the loads in flight stays within the budget, a single object may exceed it.
+	std::vector<std::shared_ptr<BLAS>> LoadObjects(const std::vector<ObjectLoadRequest>& requests, const BLASCache& cache, uint32_t threadCount, size_t memoryBudget);
 }
@@ -0,0 +1,219 @@
+#include "LightBVH.h"
+
+#include <algorithm>
+
+#include "LightSampler.h"
+
+void LightBVH::Build(const std::vector<PointLight>& pointLights)
+{
+	m_Nodes.clear();
+	m_LightIndices.resize(pointLights.size());
+
+	if (pointLights.empty())
+		return;
+
+	for (uint32_t i = 0; i < pointLights.size(); i++)
+		m_LightIndices[i] = i;
+
+	m_Nodes.reserve(2 * (pointLights.size() / MaxLeafLights + 1));
+	m_Nodes.emplace_back();
+	Subdivide(pointLights, 0, 0, pointLights.size());
+
+	m_BuildSurfaceArea = CalcSurfaceArea();
+}
+
+void LightBVH::Subdivide(const std::vector<PointLight>& pointLights, uint32_t nodeIndex, uint32_t first, uint32_t count)
+{
+	glm::vec3 aabbMin(std::numeric_limits<float>().max());
+	glm::vec3 aabbMax(-std::numeric_limits<float>().max());
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		aabbMin = glm::min(aabbMin, pointLights[m_LightIndices[i]].position);
+		aabbMax = glm::max(aabbMax, pointLights[m_LightIndices[i]].position);
+	}
+
+	if (count <= MaxLeafLights)
+	{
+		m_Nodes[nodeIndex].leftFirst = first;
+		m_Nodes[nodeIndex].lightCount = count;
+		UpdateLeaf(pointLights, m_Nodes[nodeIndex]);
+		return;
+	}
+
+	// Object median split along the longest axis keeps the tree balanced
+	glm::vec3 extent = aabbMax - aabbMin;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	uint32_t leftCount = count / 2;
+
+	auto begin = m_LightIndices.begin() + first;
+	std::nth_element(begin, begin + leftCount, begin + count, [&](uint32_t a, uint32_t b) {
+		return pointLights[a].position[axis] < pointLights[b].position[axis];
+	});
+
+	uint32_t leftIndex = m_Nodes.size();
+	m_Nodes.emplace_back();
+	m_Nodes.emplace_back();
+
+	Subdivide(pointLights, leftIndex, first, leftCount);
+	Subdivide(pointLights, leftIndex + 1, first + leftCount, count - leftCount);
+
+	Node& node = m_Nodes[nodeIndex];
+	node.leftFirst = leftIndex;
+	node.lightCount = 0;
+	node.aabbMin = aabbMin;
+	node.aabbMax = aabbMax;
+	node.power = m_Nodes[leftIndex].power + m_Nodes[leftIndex + 1].power;
+}
+
+void LightBVH::UpdateLeaf(const std::vector<PointLight>& pointLights, Node& node) const
+{
+	node.aabbMin = glm::vec3(std::numeric_limits<float>().max());
+	node.aabbMax = glm::vec3(-std::numeric_limits<float>().max());
+	node.power = 0.0f;
+
+	for (uint32_t i = node.leftFirst; i < node.leftFirst + node.lightCount; i++)
+	{
+		const PointLight& pointLight = pointLights[m_LightIndices[i]];
+		node.aabbMin = glm::min(node.aabbMin, pointLight.position);
+		node.aabbMax = glm::max(node.aabbMax, pointLight.position);
+		node.power += LightSampler::GetLightPower(pointLight);
+	}
+}
+
+void LightBVH::Refit(const std::vector<PointLight>& pointLights)
+{
+	// Children are always stored after their parent, so a reverse sweep updates bottom-up
+	for (int32_t i = static_cast<int32_t>(m_Nodes.size()) - 1; i >= 0; i--)
+	{
+		Node& node = m_Nodes[i];
+		if (node.IsLeaf())
+		{
+			UpdateLeaf(pointLights, node);
+			continue;
+		}
+
+		const Node& left = m_Nodes[node.leftFirst];
+		const Node& right = m_Nodes[node.leftFirst + 1];
+		node.aabbMin = glm::min(left.aabbMin, right.aabbMin);
+		node.aabbMax = glm::max(left.aabbMax, right.aabbMax);
+		node.power = left.power + right.power;
+	}
+}
+
+void LightBVH::Update(const std::vector<PointLight>& pointLights)
+{
+	if (m_LightIndices.size() != pointLights.size() || m_Nodes.empty())
+	{
+		Build(pointLights);
+		return;
+	}
+
+	Refit(pointLights);
+
+	if (CalcSurfaceArea() > RebuildSurfaceAreaRatio * m_BuildSurfaceArea)
+		Build(pointLights);
+}
+
+float LightBVH::CalcSurfaceArea() const
+{
+	float surfaceArea = 0.0f;
+	for (const Node& node : m_Nodes)
+	{
+		glm::vec3 extent = node.aabbMax - node.aabbMin;
+		surfaceArea += extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+
+	return surfaceArea;
+}
+
+float LightBVH::CalcImportance(const Node& node, const glm::vec3& position, const glm::vec3& normal)
+{
+	glm::vec3 center = 0.5f * (node.aabbMin + node.aabbMax);
+	glm::vec3 halfExtent = 0.5f * (node.aabbMax - node.aabbMin);
+
+	// Skip nodes that are completely behind the shading surface
+	if (glm::dot(normal, center - position) + glm::dot(glm::abs(normal), halfExtent) <= 0.0f)
+		return 0.0f;
+
+	// Clamp distance to the node radius so nearby and enclosing nodes don't blow up
+	glm::vec3 toCenter = center - position;
+	float distanceSquared = std::max(glm::dot(toCenter, toCenter), glm::dot(halfExtent, halfExtent));
+
+	return node.power / std::max(distanceSquared, 0.0001f);
+}
+
+float LightBVH::CalcImportance(const PointLight& pointLight, const glm::vec3& position, const glm::vec3& normal)
+{
+	glm::vec3 toLight = pointLight.position - position;
+	if (glm::dot(normal, toLight) <= 0.0f)
+		return 0.0f;
+
+	return LightSampler::GetLightPower(pointLight) / std::max(glm::dot(toLight, toLight), 0.0001f);
+}
+
+uint32_t LightBVH::Sample(const std::vector<PointLight>& pointLights, const glm::vec3& position, const glm::vec3& normal, float random, float& pdf) const
+{
+	pdf = 0.0f;
+	if (m_Nodes.empty())
+		return 0;
+
+	float nodePdf = 1.0f;
+	const Node* node = &m_Nodes[0];
+	while (!node->IsLeaf())
+	{
+		const Node& left = m_Nodes[node->leftFirst];
+		const Node& right = m_Nodes[node->leftFirst + 1];
+		float leftImportance = CalcImportance(left, position, normal);
+		float rightImportance = CalcImportance(right, position, normal);
+		float importanceTotal = leftImportance + rightImportance;
+
+		if (importanceTotal <= 0.0f)
+			return 0;
+
+		float leftProbability = leftImportance / importanceTotal;
+		if (random < leftProbability)
+		{
+			random = random / leftProbability;
+			nodePdf *= leftProbability;
+			node = &left;
+		}
+		else
+		{
+			random = (random - leftProbability) / (1.0f - leftProbability);
+			nodePdf *= 1.0f - leftProbability;
+			node = &right;
+		}
+		random = std::min(random, 0.99999994f);
+	}
+
+	// Pick a light within the leaf proportional to its own importance
+	float lightImportances[MaxLeafLights];
+	float importanceTotal = 0.0f;
+	for (uint32_t i = 0; i < node->lightCount; i++)
+	{
+		lightImportances[i] = CalcImportance(pointLights[m_LightIndices[node->leftFirst + i]], position, normal);
+		importanceTotal += lightImportances[i];
+	}
+
+	if (importanceTotal <= 0.0f)
+		return 0;
+
+	float target = random * importanceTotal;
+	uint32_t selected = node->lightCount - 1;
+	for (uint32_t i = 0; i < node->lightCount; i++)
+	{
+		if (target < lightImportances[i] && lightImportances[i] > 0.0f)
+		{
+			selected = i;
+			break;
+		}
+		target -= lightImportances[i];
+	}
+
+	// Floating point leftovers can land on a zero importance light
+	while (lightImportances[selected] <= 0.0f)
+		selected--;
+
+	pdf = nodePdf * lightImportances[selected] / importanceTotal;
+	return m_LightIndices[node->leftFirst + selected];
+}
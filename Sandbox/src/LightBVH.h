@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Include.h"
+
+#include "PointLight.h"
+
+// Bounding volume hierarchy over point lights, traversed stochastically to pick a light
+// proportional to an estimate of its contribution to a shading point.
+class LightBVH
+{
+private:
+	struct Node
+	{
+		glm::vec3 aabbMin;
+		uint32_t leftFirst; // Left child index for interior nodes, first light index for leafs
+		glm::vec3 aabbMax;
+		uint32_t lightCount; // 0 for interior nodes
+		float power;
+
+		bool IsLeaf() const { return lightCount > 0; }
+	};
+
+	static constexpr uint32_t MaxLeafLights = 4;
+	// Refitted hierarchy gets rebuilt once its node surface area grows past this factor
+	static constexpr float RebuildSurfaceAreaRatio = 2.0f;
+
+	std::vector<Node> m_Nodes;
+	std::vector<uint32_t> m_LightIndices;
+	float m_BuildSurfaceArea;
+public:
+	LightBVH() :
+		m_BuildSurfaceArea{ 0.0f }
+	{}
+
+	~LightBVH() = default;
+
+	void Build(const std::vector<PointLight>& pointLights);
+	void Refit(const std::vector<PointLight>& pointLights);
+	// Refits when the light count is unchanged, rebuilds otherwise or when the refit degraded the hierarchy
+	void Update(const std::vector<PointLight>& pointLights);
+
+	// Returns the index of the sampled light, pdf is 0 when no light can contribute to the shading point.
+	// Random in [0, 1), it is rescaled after every decision so one value drives the whole traversal.
+	uint32_t Sample(const std::vector<PointLight>& pointLights, const glm::vec3& position, const glm::vec3& normal, float random, float& pdf) const;
+
+	uint32_t GetLightCount() const { return m_LightIndices.size(); }
+private:
+	void Subdivide(const std::vector<PointLight>& pointLights, uint32_t nodeIndex, uint32_t first, uint32_t count);
+	void UpdateLeaf(const std::vector<PointLight>& pointLights, Node& node) const;
+	float CalcSurfaceArea() const;
+
+	static float CalcImportance(const Node& node, const glm::vec3& position, const glm::vec3& normal);
+	static float CalcImportance(const PointLight& pointLight, const glm::vec3& position, const glm::vec3& normal);
+};
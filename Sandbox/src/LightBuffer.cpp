@@ -0,0 +1,11 @@
+#include "LightBuffer.h"
+
+std::atomic<uint64_t> LightBuffer::s_NextVersion{ 0 };
+
+LightBuffer::LightBuffer() :
+	m_PointLights{ std::vector<PointLight>() }, m_Version{ s_NextVersion++ }
+{}
+
+LightBuffer::LightBuffer(std::vector<PointLight>&& pointLights) :
+	m_PointLights{ std::move(pointLights) }, m_Version{ s_NextVersion++ }
+{}
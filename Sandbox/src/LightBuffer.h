@@ -0,0 +1,31 @@
+#pragma once
+
+#include <atomic>
+
+#include "Include.h"
+
+#include "PointLight.h"
+
+// Immutable set of point lights shared between the UI and render thread. Changing the lights
+// means creating a new buffer, which gets a new version, so a submitted scene only copies a
+// pointer and the renderer rebuilds its light samplers only when the version changes.
+class LightBuffer
+{
+private:
+	std::vector<PointLight> m_PointLights;
+	uint64_t m_Version;
+
+	static std::atomic<uint64_t> s_NextVersion;
+public:
+	LightBuffer();
+	LightBuffer(std::vector<PointLight>&& pointLights);
+
+	~LightBuffer() = default;
+
+	const PointLight& GetLight(uint32_t index) const { return m_PointLights[index]; }
+	const std::vector<PointLight>& GetPointLights() const { return m_PointLights; }
+	uint32_t GetCount() const { return m_PointLights.size(); }
+	uint64_t GetVersion() const { return m_Version; }
+};
+
+using LightBufferRef = std::shared_ptr<const LightBuffer>;
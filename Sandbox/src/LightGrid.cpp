@@ -0,0 +1,87 @@
+#include "LightGrid.h"
+
+#include "Utils.h"
+
+void LightGrid::Configure(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t gridResolution, uint32_t resevoirsPerCell)
+{
+	glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(0.0001f));
+	float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+
+	m_GridMin = boundsMin;
+	m_CellSize = maxExtent / static_cast<float>(std::max(1u, gridResolution));
+	m_Resolution = glm::max(glm::i32vec3(glm::ceil(extent / m_CellSize)), glm::i32vec3(1));
+	m_ResevoirsPerCell = std::max(1u, resevoirsPerCell);
+
+	uint32_t resevoirCount = GetCellCount() * m_ResevoirsPerCell;
+	if (m_Resevoirs.size() != resevoirCount)
+		m_Resevoirs.resize(resevoirCount);
+}
+
+glm::vec3 LightGrid::GetCellCenter(uint32_t cellIndex) const
+{
+	uint32_t x = cellIndex % m_Resolution.x;
+	uint32_t y = (cellIndex / m_Resolution.x) % m_Resolution.y;
+	uint32_t z = cellIndex / (m_Resolution.x * m_Resolution.y);
+
+	return m_GridMin + (glm::vec3(x, y, z) + 0.5f) * m_CellSize;
+}
+
+void LightGrid::FillCells(uint32_t firstCell, uint32_t cellCount, const std::vector<PointLight>& pointLights, const AliasTable& lightPowerTable, uint32_t candidatesPerCell, uint32_t seed)
+{
+	uint32_t candidatesPerResevoir = std::max(1u, candidatesPerCell / m_ResevoirsPerCell);
+	// Distances are clamped to the cell radius, every light inside the cell is treated equally
+	float minDistanceSquared = 0.75f * m_CellSize * m_CellSize;
+
+	uint32_t lastCell = std::min(firstCell + cellCount, GetCellCount());
+	for (uint32_t cellIndex = firstCell; cellIndex < lastCell; cellIndex++)
+	{
+		glm::vec3 cellCenter = GetCellCenter(cellIndex);
+
+		for (uint32_t resevoirIndex = 0; resevoirIndex < m_ResevoirsPerCell; resevoirIndex++)
+		{
+			uint32_t selectedLight = 0;
+			float selectedTargetPdf = 0.0f;
+			float weightTotal = 0.0f;
+
+			// Streaming RIS with power based source pdf and a cell center target function
+			for (uint32_t i = 0; i < candidatesPerResevoir; i++)
+			{
+				float sourcePdf;
+				uint32_t lightIndex = lightPowerTable.Sample(seed, sourcePdf);
+				if (sourcePdf <= 0.0f)
+					continue;
+
+				glm::vec3 toLight = pointLights[lightIndex].position - cellCenter;
+				float targetPdf = LightSampler::GetLightPower(pointLights[lightIndex]) / std::max(glm::dot(toLight, toLight), minDistanceSquared);
+				float weight = targetPdf / sourcePdf;
+
+				weightTotal += weight;
+				if (Utils::RandomFloat(seed) * weightTotal < weight)
+				{
+					selectedLight = lightIndex;
+					selectedTargetPdf = targetPdf;
+				}
+			}
+
+			CellResevoir& resevoir = m_Resevoirs[cellIndex * m_ResevoirsPerCell + resevoirIndex];
+			resevoir.lightIndex = selectedLight;
+			resevoir.weight = selectedTargetPdf > 0.0f ? weightTotal / (selectedTargetPdf * candidatesPerResevoir) : 0.0f;
+		}
+	}
+}
+
+bool LightGrid::Sample(const glm::vec3& position, float random, uint32_t& lightIndex, float& pdf) const
+{
+	glm::i32vec3 cell = glm::i32vec3(glm::floor((position - m_GridMin) / m_CellSize));
+	if (m_Resevoirs.empty() || glm::any(glm::lessThan(cell, glm::i32vec3(0))) || glm::any(glm::greaterThanEqual(cell, m_Resolution)))
+		return false;
+
+	uint32_t cellIndex = cell.x + m_Resolution.x * (cell.y + m_Resolution.y * cell.z);
+	uint32_t resevoirIndex = std::min(static_cast<uint32_t>(random * m_ResevoirsPerCell), m_ResevoirsPerCell - 1);
+	const CellResevoir& resevoir = m_Resevoirs[cellIndex * m_ResevoirsPerCell + resevoirIndex];
+
+	// The resevoir weight estimates the inverse pdf of its light
+	lightIndex = resevoir.lightIndex;
+	pdf = resevoir.weight > 0.0f ? 1.0f / resevoir.weight : 0.0f;
+	return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Include.h"
+
+#include "PointLight.h"
+#include "LightSampler.h"
+
+// World space grid with a few light resevoirs per cell (ReGIR), refilled every frame.
+// Shading points draw candidates from the resevoirs of their cell, amortizing the
+// many-light sampling cost over all pixels in that cell.
+class LightGrid
+{
+private:
+	struct CellResevoir
+	{
+		uint32_t lightIndex;
+		float weight; // Unbiased contribution weight of the selected light, 0 when nothing was selected
+	};
+
+	glm::vec3 m_GridMin;
+	float m_CellSize;
+	glm::i32vec3 m_Resolution;
+	uint32_t m_ResevoirsPerCell;
+	std::vector<CellResevoir> m_Resevoirs;
+public:
+	LightGrid() :
+		m_GridMin{ glm::vec3(0) }, m_CellSize{ 1.0f }, m_Resolution{ glm::i32vec3(0) }, m_ResevoirsPerCell{ 0 }
+	{}
+
+	~LightGrid() = default;
+
+	// Cells are cubes, gridResolution is the cell count along the longest axis of the bounds
+	void Configure(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t gridResolution, uint32_t resevoirsPerCell);
+	void FillCells(uint32_t firstCell, uint32_t cellCount, const std::vector<PointLight>& pointLights, const AliasTable& lightPowerTable, uint32_t candidatesPerCell, uint32_t seed);
+
+	// Returns false when the position lies outside the grid, pdf is 0 when the cell has no usable light
+	bool Sample(const glm::vec3& position, float random, uint32_t& lightIndex, float& pdf) const;
+
+	uint32_t GetCellCount() const { return m_Resolution.x * m_Resolution.y * m_Resolution.z; }
+private:
+	glm::vec3 GetCellCenter(uint32_t cellIndex) const;
+};
@@ -0,0 +1,145 @@
+#include "LightHashGrid.h"
+
+#include <algorithm>
+
+#include "LightSampler.h"
+
+float LightHashGrid::GetInfluenceRadius(const PointLight& pointLight, float influenceCutoff)
+{
+	// Power / distance^2 drops below the cutoff beyond this radius
+	return std::sqrt(LightSampler::GetLightPower(pointLight) / std::max(influenceCutoff, 0.000001f));
+}
+
+bool LightHashGrid::IsBuiltFor(uint64_t lightBufferVersion, const glm::vec3& sceneMin, const glm::vec3& sceneMax, float cellSize, float influenceCutoff) const
+{
+	bool sceneCovered = glm::all(glm::greaterThanEqual(sceneMin, m_BoundsMin)) && glm::all(glm::lessThanEqual(sceneMax, m_BoundsMax));
+	return m_LightBufferVersion == lightBufferVersion && m_CellSize == std::max(cellSize, 0.001f) && m_InfluenceCutoff == influenceCutoff && sceneCovered;
+}
+
+void LightHashGrid::Build(const std::vector<PointLight>& pointLights, uint64_t lightBufferVersion, const glm::vec3& sceneMin, const glm::vec3& sceneMax, float cellSize, float influenceCutoff)
+{
+	m_CellSize = std::max(cellSize, 0.001f);
+	m_InfluenceCutoff = influenceCutoff;
+	m_LightBufferVersion = lightBufferVersion;
+
+	glm::vec3 margin = glm::max((sceneMax - sceneMin) * BoundsMargin, glm::vec3(m_CellSize));
+	m_BoundsMin = sceneMin - margin;
+	m_BoundsMax = sceneMax + margin;
+	glm::i32vec3 boundsCellMin = GetCell(m_BoundsMin);
+	glm::i32vec3 boundsCellMax = GetCell(m_BoundsMax);
+
+	auto getLightCells = [&](const PointLight& pointLight, float radius, glm::i32vec3& cellMin, glm::i32vec3& cellMax) {
+		glm::i32vec3 lightCell = GetCell(pointLight.position);
+		cellMin = glm::max(glm::max(GetCell(pointLight.position - radius), lightCell - MaxCellRadius), boundsCellMin);
+		cellMax = glm::min(glm::min(GetCell(pointLight.position + radius), lightCell + MaxCellRadius), boundsCellMax);
+	};
+
+	// Collect (bucket, light) pairs for every cell a light's influence sphere overlaps
+	struct Entry
+	{
+		uint32_t bucket;
+		uint32_t lightIndex;
+	};
+	std::vector<Entry> entries;
+	entries.reserve(pointLights.size() * 8);
+
+	std::vector<glm::i32vec3> cells;
+	uint64_t occupiedCellEstimate = 1;
+	for (uint32_t i = 0; i < pointLights.size(); i++)
+	{
+		glm::i32vec3 cellMin, cellMax;
+		getLightCells(pointLights[i], GetInfluenceRadius(pointLights[i], influenceCutoff), cellMin, cellMax);
+		if (glm::any(glm::greaterThan(cellMin, cellMax)))
+			continue;
+
+		glm::i32vec3 cellCount = cellMax - cellMin + 1;
+		occupiedCellEstimate += static_cast<uint64_t>(cellCount.x) * cellCount.y * cellCount.z;
+	}
+
+	// Size the table before hashing, about two buckets per occupied cell
+	uint32_t bucketCount = 1024;
+	while (bucketCount < 2 * occupiedCellEstimate && bucketCount < (1u << 24))
+		bucketCount <<= 1;
+	m_BucketMask = bucketCount - 1;
+
+	for (uint32_t i = 0; i < pointLights.size(); i++)
+	{
+		const glm::vec3& lightPosition = pointLights[i].position;
+		float radius = GetInfluenceRadius(pointLights[i], influenceCutoff);
+		glm::i32vec3 cellMin, cellMax;
+		getLightCells(pointLights[i], radius, cellMin, cellMax);
+
+		for (int32_t z = cellMin.z; z <= cellMax.z; z++)
+		{
+			for (int32_t y = cellMin.y; y <= cellMax.y; y++)
+			{
+				for (int32_t x = cellMin.x; x <= cellMax.x; x++)
+				{
+					// Skip cells whose box lies completely outside the influence sphere
+					glm::vec3 cellBoxMin = glm::vec3(x, y, z) * m_CellSize;
+					glm::vec3 closestPoint = glm::clamp(lightPosition, cellBoxMin, cellBoxMin + m_CellSize);
+					glm::vec3 toClosest = closestPoint - lightPosition;
+					if (glm::dot(toClosest, toClosest) > radius * radius)
+						continue;
+
+					entries.push_back({ GetBucket(glm::i32vec3(x, y, z)), i });
+				}
+			}
+		}
+	}
+
+	// Group entries by bucket, a light can land in one bucket through several cells
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.bucket != b.bucket ? a.bucket < b.bucket : a.lightIndex < b.lightIndex;
+	});
+	entries.erase(std::unique(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.bucket == b.bucket && a.lightIndex == b.lightIndex;
+	}), entries.end());
+
+	m_BucketOffsets.assign(bucketCount + 1, 0);
+	m_LightIndices.resize(entries.size());
+	m_CumulativePower.resize(entries.size());
+
+	for (const Entry& entry : entries)
+		m_BucketOffsets[entry.bucket + 1]++;
+	for (uint32_t bucket = 0; bucket < bucketCount; bucket++)
+		m_BucketOffsets[bucket + 1] += m_BucketOffsets[bucket];
+
+	float powerTotal = 0.0f;
+	for (uint32_t i = 0; i < entries.size(); i++)
+	{
+		if (i == 0 || entries[i].bucket != entries[i - 1].bucket)
+			powerTotal = 0.0f;
+
+		powerTotal += LightSampler::GetLightPower(pointLights[entries[i].lightIndex]);
+		m_LightIndices[i] = entries[i].lightIndex;
+		m_CumulativePower[i] = powerTotal;
+	}
+}
+
+bool LightHashGrid::Sample(const glm::vec3& position, float random, uint32_t& lightIndex, float& pdf) const
+{
+	pdf = 0.0f;
+	if (m_BucketOffsets.empty())
+		return false;
+
+	uint32_t bucket = GetBucket(GetCell(position));
+	uint32_t first = m_BucketOffsets[bucket];
+	uint32_t last = m_BucketOffsets[bucket + 1];
+	if (first == last)
+		return false;
+
+	float powerTotal = m_CumulativePower[last - 1];
+	if (powerTotal <= 0.0f)
+		return false;
+
+	// Binary search the running power sum of the bucket
+	float target = random * powerTotal;
+	uint32_t entry = std::upper_bound(m_CumulativePower.begin() + first, m_CumulativePower.begin() + last, target) - m_CumulativePower.begin();
+	entry = std::min(entry, last - 1);
+
+	float previousPower = entry > first ? m_CumulativePower[entry - 1] : 0.0f;
+	lightIndex = m_LightIndices[entry];
+	pdf = (m_CumulativePower[entry] - previousPower) / powerTotal;
+	return pdf > 0.0f;
+}
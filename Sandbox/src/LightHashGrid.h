@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Include.h"
+
+#include "PointLight.h"
+
+// Spatial hash from world cells to the lights that can affect them. A light's influence radius
+// is the distance at which its power falls below the cutoff, lights outside it are ignored.
+// Cells that hash to the same bucket share a light list, which only adds candidates.
+class LightHashGrid
+{
+public:
+	// Lights only reach this many cells out from their own, bounds the entries of very bright lights
+	static constexpr int32_t MaxCellRadius = 16;
+	// Covered bounds are the scene bounds grown by this fraction, instances can move a bit before a rebuild
+	static constexpr float BoundsMargin = 0.25f;
+private:
+	float m_CellSize;
+	float m_InfluenceCutoff;
+	uint64_t m_LightBufferVersion;
+	uint32_t m_BucketMask;
+	glm::vec3 m_BoundsMin; // Covered by the light lists
+	glm::vec3 m_BoundsMax;
+
+	std::vector<uint32_t> m_BucketOffsets; // Range of each bucket in the entry arrays
+	std::vector<uint32_t> m_LightIndices;
+	std::vector<float> m_CumulativePower; // Per bucket running sum, for power proportional selection
+public:
+	LightHashGrid() :
+		m_CellSize{ 1.0f }, m_InfluenceCutoff{ 0.0f }, m_LightBufferVersion{ std::numeric_limits<uint64_t>::max() }, m_BucketMask{ 0 },
+		m_BoundsMin{ glm::vec3(0) }, m_BoundsMax{ glm::vec3(0) }
+	{}
+
+	~LightHashGrid() = default;
+
+	// Lights are only inserted into cells within the scene bounds plus a margin, shading points lie inside the scene
+	void Build(const std::vector<PointLight>& pointLights, uint64_t lightBufferVersion, const glm::vec3& sceneMin, const glm::vec3& sceneMax, float cellSize, float influenceCutoff);
+	// False as well once the scene has grown past the covered bounds
+	bool IsBuiltFor(uint64_t lightBufferVersion, const glm::vec3& sceneMin, const glm::vec3& sceneMax, float cellSize, float influenceCutoff) const;
+
+	// Returns false when no light reaches the cell of the position
+	bool Sample(const glm::vec3& position, float random, uint32_t& lightIndex, float& pdf) const;
+
+	static float GetInfluenceRadius(const PointLight& pointLight, float influenceCutoff);
+private:
+	glm::i32vec3 GetCell(const glm::vec3& position) const { return glm::i32vec3(glm::floor(position / m_CellSize)); }
+	uint32_t GetBucket(const glm::i32vec3& cell) const
+	{
+		uint32_t hash = (static_cast<uint32_t>(cell.x) * 73856093u) ^ (static_cast<uint32_t>(cell.y) * 19349663u) ^ (static_cast<uint32_t>(cell.z) * 83492791u);
+		return hash & m_BucketMask;
+	}
+};
@@ -0,0 +1,98 @@
+#include "LightSampler.h"
+
+#include "Utils.h"
+
+//=================== AliasTable =====================
+
+void AliasTable::Build(const std::vector<float>& weights)
+{
+	uint32_t size = weights.size();
+	m_Buckets.resize(size);
+	m_Pdfs.resize(size);
+
+	if (size == 0)
+		return;
+
+	float weightTotal = 0.0f;
+	for (float weight : weights)
+		weightTotal += std::max(0.0f, weight);
+
+	// Fall back to uniform sampling when no weight is usable
+	bool uniform = !(weightTotal > 0.0f) || std::isinf(weightTotal);
+
+	// Scale weights so the average bucket holds exactly 1
+	std::vector<float> scaledWeights(size);
+	std::vector<uint32_t> smallBuckets;
+	std::vector<uint32_t> largeBuckets;
+	smallBuckets.reserve(size);
+	largeBuckets.reserve(size);
+
+	for (uint32_t i = 0; i < size; i++)
+	{
+		m_Pdfs[i] = uniform ? 1.0f / size : std::max(0.0f, weights[i]) / weightTotal;
+		scaledWeights[i] = m_Pdfs[i] * size;
+
+		if (scaledWeights[i] < 1.0f)
+			smallBuckets.push_back(i);
+		else
+			largeBuckets.push_back(i);
+	}
+
+	while (!smallBuckets.empty() && !largeBuckets.empty())
+	{
+		uint32_t small = smallBuckets.back();
+		uint32_t large = largeBuckets.back();
+		smallBuckets.pop_back();
+
+		m_Buckets[small].threshold = scaledWeights[small];
+		m_Buckets[small].alias = large;
+
+		// Large bucket donates the remainder of the small bucket
+		scaledWeights[large] = (scaledWeights[large] + scaledWeights[small]) - 1.0f;
+		if (scaledWeights[large] < 1.0f)
+		{
+			largeBuckets.pop_back();
+			smallBuckets.push_back(large);
+		}
+	}
+
+	// Leftovers are full buckets up to floating point error
+	for (uint32_t index : largeBuckets)
+		m_Buckets[index] = { 1.0f, index };
+
+	for (uint32_t index : smallBuckets)
+		m_Buckets[index] = { 1.0f, index };
+}
+
+uint32_t AliasTable::Sample(uint32_t& seed, float& pdf) const
+{
+	// Full 32 bits for the bucket, the float conversion would only keep 24
+	uint32_t bucketIndex = static_cast<uint32_t>((static_cast<uint64_t>(Utils::PCGHash(seed)) * m_Buckets.size()) >> 32);
+	return SampleBucket(bucketIndex, Utils::RandomFloat(seed), pdf);
+}
+
+uint32_t AliasTable::Sample(const glm::vec2& random, float& pdf) const
+{
+	uint32_t bucketIndex = std::min(static_cast<uint32_t>(random.x * m_Buckets.size()), static_cast<uint32_t>(m_Buckets.size() - 1));
+	return SampleBucket(bucketIndex, random.y, pdf);
+}
+
+uint32_t AliasTable::SampleBucket(uint32_t bucketIndex, float random, float& pdf) const
+{
+	const Bucket& bucket = m_Buckets[bucketIndex];
+	uint32_t index = random < bucket.threshold ? bucketIndex : bucket.alias;
+
+	pdf = m_Pdfs[index];
+	return index;
+}
+
+//=================== LightSampler =====================
+
+void LightSampler::BuildPowerAliasTable(const std::vector<PointLight>& pointLights, AliasTable& aliasTable)
+{
+	std::vector<float> lightPowers(pointLights.size());
+	for (uint32_t i = 0; i < pointLights.size(); i++)
+		lightPowers[i] = GetLightPower(pointLights[i]);
+
+	aliasTable.Build(lightPowers);
+}
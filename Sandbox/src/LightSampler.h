@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Include.h"
+
+#include "PointLight.h"
+
+// Walker alias table, samples an index proportional to its weight in constant time
+class AliasTable
+{
+private:
+	struct Bucket
+	{
+		float threshold;
+		uint32_t alias;
+	};
+
+	std::vector<Bucket> m_Buckets;
+	std::vector<float> m_Pdfs;
+public:
+	AliasTable() = default;
+	~AliasTable() = default;
+
+	void Build(const std::vector<float>& weights);
+	uint32_t Sample(uint32_t& seed, float& pdf) const;
+	// Randoms in [0, 1), x picks the bucket and y between it and its alias. A single value split
+	// in two leaves too few bits for the threshold once there are millions of buckets.
+	uint32_t Sample(const glm::vec2& random, float& pdf) const;
+
+	float GetPdf(uint32_t index) const { return m_Pdfs[index]; }
+	uint32_t GetSize() const { return m_Buckets.size(); }
+private:
+	uint32_t SampleBucket(uint32_t bucketIndex, float random, float& pdf) const;
+};
+
+namespace LightSampler
+{
+	// Luminance of the light emission, used as sampling weight
+	static inline float GetLightPower(const PointLight& pointLight)
+	{
+		return glm::dot(pointLight.emmission, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	}
+
+	void BuildPowerAliasTable(const std::vector<PointLight>& pointLights, AliasTable& aliasTable);
+}
@@ -16,4 +16,14 @@ public:
 	PointLight(const glm::vec3& position, const glm::vec3& color, float intensity):
 		position{ position }, emmission{ color * intensity }
 	{}
+
+	bool operator==(const PointLight& otherLight) const
+	{
+		return position == otherLight.position && emmission == otherLight.emmission;
+	}
+
+	bool operator!=(const PointLight& otherLight) const
+	{
+		return !operator==(otherLight);
+	}
 };
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "PostProcessing.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "Utils.h"
+
+namespace PostProcessing
+{
+	static inline float TonemapChannel(float value, RendererSettings::TonemapOperator tonemapper)
+	{
+		switch (tonemapper)
+		{
+		case RendererSettings::TonemapOperator::Reinhard:
+			return value / (1.0f + value);
+		case RendererSettings::TonemapOperator::ACES:
+			// Narkowicz ACES filmic curve fit
+			return (value * (2.51f * value + 0.03f)) / (value * (2.43f * value + 0.59f) + 0.14f);
+		default:
+			return value;
+		}
+	}
+
+	static inline float LinearToSRGB(float value)
+	{
+		// Square root based fit of the sRGB curve, identical to the AVX2 path
+		float sqrt1 = std::sqrt(value);
+		float sqrt2 = std::sqrt(sqrt1);
+		float sqrt3 = std::sqrt(sqrt2);
+		float curve = 0.662002687f * sqrt1 + 0.684122060f * sqrt2 - 0.323583601f * sqrt3 - 0.0225411470f * value;
+
+		return value <= 0.0031308f ? value * 12.92f : curve;
+	}
+
+	static inline uint8_t DisplayChannel(float value, const DisplaySettings& displaySettings)
+	{
+		value = TonemapChannel(value * displaySettings.Exposure, displaySettings.Tonemapper);
+		value = Utils::Clamp(value, 1.0f, 0.0f);
+
+		if (displaySettings.SRGBOutput)
+			value = LinearToSRGB(value);
+
+		// Truncated like the frame buffer conversion has always been
+		return static_cast<uint8_t>(value * 255.0f);
+	}
+
+#if defined(__AVX2__)
+	static inline __m256 TonemapAVX2(__m256 value, RendererSettings::TonemapOperator tonemapper)
+	{
+		switch (tonemapper)
+		{
+		case RendererSettings::TonemapOperator::Reinhard:
+			return _mm256_div_ps(value, _mm256_add_ps(_mm256_set1_ps(1.0f), value));
+		case RendererSettings::TonemapOperator::ACES:
+		{
+			__m256 numerator = _mm256_mul_ps(value, _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(2.51f)), _mm256_set1_ps(0.03f)));
+			__m256 denominator = _mm256_mul_ps(value, _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(2.43f)), _mm256_set1_ps(0.59f)));
+			denominator = _mm256_add_ps(denominator, _mm256_set1_ps(0.14f));
+			return _mm256_div_ps(numerator, denominator);
+		}
+		default:
+			return value;
+		}
+	}
+
+	static inline __m256 LinearToSRGBAVX2(__m256 value)
+	{
+		__m256 sqrt1 = _mm256_sqrt_ps(value);
+		__m256 sqrt2 = _mm256_sqrt_ps(sqrt1);
+		__m256 sqrt3 = _mm256_sqrt_ps(sqrt2);
+
+		__m256 curve = _mm256_mul_ps(sqrt1, _mm256_set1_ps(0.662002687f));
+		curve = _mm256_add_ps(curve, _mm256_mul_ps(sqrt2, _mm256_set1_ps(0.684122060f)));
+		curve = _mm256_sub_ps(curve, _mm256_mul_ps(sqrt3, _mm256_set1_ps(0.323583601f)));
+		curve = _mm256_sub_ps(curve, _mm256_mul_ps(value, _mm256_set1_ps(0.0225411470f)));
+
+		__m256 linear = _mm256_mul_ps(value, _mm256_set1_ps(12.92f));
+		__m256 linearMask = _mm256_cmp_ps(value, _mm256_set1_ps(0.0031308f), _CMP_LE_OQ);
+
+		return _mm256_blendv_ps(curve, linear, linearMask);
+	}
+
+	// Converts two RGBA pixels into 32-bit integer channels in the [0, 255] range
+	static inline __m256i DisplayPixelPairAVX2(const float* hdrPixelPair, const DisplaySettings& displaySettings)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+
+		__m256 hdrColor = _mm256_loadu_ps(hdrPixelPair);
+		__m256 color = _mm256_mul_ps(hdrColor, _mm256_set1_ps(displaySettings.Exposure));
+		color = TonemapAVX2(color, displaySettings.Tonemapper);
+		color = _mm256_min_ps(_mm256_max_ps(color, zero), one);
+
+		if (displaySettings.SRGBOutput)
+			color = LinearToSRGBAVX2(color);
+
+		// Alpha is passed through without exposure or tonemapping
+		__m256 alpha = _mm256_min_ps(_mm256_max_ps(hdrColor, zero), one);
+		color = _mm256_blend_ps(color, alpha, 0x88);
+
+		// Truncates like DisplayChannel
+		return _mm256_cvttps_epi32(_mm256_mul_ps(color, _mm256_set1_ps(255.0f)));
+	}
+#endif
+
+	void TonemapKernel(const glm::vec4* hdrPixels, uint8_t* displayPixels, uint32_t pixelCount, const DisplaySettings& displaySettings)
+	{
+		uint32_t pixelIndex = 0;
+
+#if defined(__AVX2__)
+		const float* hdrData = glm::value_ptr(hdrPixels[0]);
+		// Restores pixel order after the in-lane packing below
+		const __m256i pixelOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+		for (; pixelIndex + 8 <= pixelCount; pixelIndex += 8)
+		{
+			const float* hdrPixelBlock = hdrData + pixelIndex * 4;
+			__m256i pixels01 = DisplayPixelPairAVX2(hdrPixelBlock + 0, displaySettings);
+			__m256i pixels23 = DisplayPixelPairAVX2(hdrPixelBlock + 8, displaySettings);
+			__m256i pixels45 = DisplayPixelPairAVX2(hdrPixelBlock + 16, displaySettings);
+			__m256i pixels67 = DisplayPixelPairAVX2(hdrPixelBlock + 24, displaySettings);
+
+			// Lanes hold pixels (0, 2, 4, 6) and (1, 3, 5, 7) after packing
+			__m256i packed0123 = _mm256_packus_epi32(pixels01, pixels23);
+			__m256i packed4567 = _mm256_packus_epi32(pixels45, pixels67);
+			__m256i packedBytes = _mm256_packus_epi16(packed0123, packed4567);
+			packedBytes = _mm256_permutevar8x32_epi32(packedBytes, pixelOrder);
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(displayPixels + pixelIndex * 4), packedBytes);
+		}
+#endif
+
+		for (; pixelIndex < pixelCount; pixelIndex++)
+		{
+			const glm::vec4& color = hdrPixels[pixelIndex];
+			uint8_t* displayPixel = displayPixels + pixelIndex * 4;
+
+			displayPixel[0] = DisplayChannel(color.r, displaySettings);
+			displayPixel[1] = DisplayChannel(color.g, displaySettings);
+			displayPixel[2] = DisplayChannel(color.b, displaySettings);
+			displayPixel[3] = static_cast<uint8_t>(Utils::Clamp(color.a, 1.0f, 0.0f) * 255.0f);
+		}
+	}
+}
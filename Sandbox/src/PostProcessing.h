@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Include.h"
+
+#include "RendererSettings.h"
+
+namespace PostProcessing
+{
+	struct DisplaySettings
+	{
+		float Exposure;
+		RendererSettings::TonemapOperator Tonemapper;
+		bool SRGBOutput;
+
+		DisplaySettings() :
+			Exposure{ 1.0f }, Tonemapper{ RendererSettings::TonemapOperator::None }, SRGBOutput{ false }
+		{}
+
+		DisplaySettings(float exposure, RendererSettings::TonemapOperator tonemapper, bool sRGBOutput) :
+			Exposure{ exposure }, Tonemapper{ tonemapper }, SRGBOutput{ sRGBOutput }
+		{}
+	};
+
+	// Applies exposure, tonemapping and sRGB encoding to linear HDR pixels and packs them into RGBA8.
+	// Uses AVX2 to process 8 pixels per iteration when available.
+	void TonemapKernel(const glm::vec4* hdrPixels, uint8_t* displayPixels, uint32_t pixelCount, const DisplaySettings& displaySettings);
+}
@@ -9,9 +9,8 @@ public:
 	float distance;
 
 	glm::vec3 position;
-	glm::vec3 prevPosition;
 	glm::vec3 normal;
-	glm::vec3 prevNormal;
+	uint32_t instanceIndex; // TLAS instance that was hit, for motion lookups
 
 	// Debug info
 	int32_t traversalStepsHitBVH;
@@ -19,8 +18,7 @@ public:
 public:
 	HitInfo():
 		hit{ false }, distance{ std::numeric_limits<float>().infinity() }, position{ glm::vec3(0) },
-		prevPosition{glm::vec3(0)}, traversalStepsHitBVH{ 0 }, traversalStepsTotal{ 0 },
-		normal{ glm::vec3(0) }, prevNormal{ glm::vec3(0) }
+		normal{ glm::vec3(0) }, instanceIndex{ 0 }, traversalStepsHitBVH{ 0 }, traversalStepsTotal{ 0 }
 	{}
 
 	HitInfo(bool hit) : // Members should be set manually after initialization
@@ -28,17 +26,26 @@ public:
 	{}
 };
 
+// A ray only hits the instances whose mask shares a bit with its own, tinybvh uses the low 16 bits
+enum RayMask : uint32_t
+{
+	RayMaskPrimary = 1 << 0,
+	RayMaskShadow = 1 << 1,
+	RayMaskAll = 0xFFFF
+};
+
 struct Ray
 {
 public:
 	glm::vec3 origin;
 	glm::vec3 direction;
+	uint32_t mask;
 	HitInfo hitInfo;
 public:
 	Ray() = default;
 
-	Ray(glm::vec3 origin, glm::vec3 direction, float tNear = std::numeric_limits<float>().infinity()) :
-		origin{ origin }, direction{ direction }, hitInfo{ HitInfo() }
+	Ray(glm::vec3 origin, glm::vec3 direction, float tNear = std::numeric_limits<float>().infinity(), uint32_t mask = RayMaskAll) :
+		origin{ origin }, direction{ direction }, mask{ mask }, hitInfo{ HitInfo() }
 	{
 		hitInfo.distance = tNear;
 	}
@@ -1,25 +1,17 @@
 #include "ReSTIR.h"
 
 
-Sample::Sample(const HitInfo& hitInfo, const glm::vec3& cameraOrigin, const PointLight& pointLight, float weight, float pdf)
+Sample::Sample(const HitInfo& hitInfo, const glm::vec3& cameraOrigin, const PointLight& pointLight, uint32_t lightIndex, float weight, float pdf)
 {
 	hit = hitInfo.hit;
 	hitDistance = hitInfo.distance;
 	hitPosition = hitInfo.position;
-	hitPrevPosition = hitInfo.prevPosition;
 	hitNormal = hitInfo.normal;
-	hitPrevNormal = hitInfo.prevNormal;
 	cameraPosition = cameraOrigin;
-	light = pointLight;
 	this->weight = weight;
 	this->pdf = pdf;
 
-	lightDirection = light.position - hitPosition;
-	lightDistance = glm::length(lightDirection);
-	lightDirection = glm::normalize(lightDirection);
-	BRDF = glm::dot(hitNormal, lightDirection);
-
-	SetContribution();
+	ReplaceLight(pointLight, lightIndex);
 }
 
 Sample::Sample(const Sample& sample, float weight)
@@ -27,31 +19,32 @@ Sample::Sample(const Sample& sample, float weight)
 	hit = sample.hit;
 	hitDistance = sample.hitDistance;
 	hitPosition = sample.hitPosition;
-	hitPrevPosition = sample.hitPrevPosition;
 	hitNormal = sample.hitNormal;
-	hitPrevNormal = sample.hitPrevNormal;
 	cameraPosition = sample.cameraPosition;
-	light = sample.light;
+	lightIndex = sample.lightIndex;
 	this->weight = weight;
 	pdf = sample.pdf;
 
 	lightDirection = sample.lightDirection;
 	lightDistance = sample.lightDistance;
 	BRDF = sample.BRDF;
-
-	SetContribution();
+	contribution = sample.contribution;
+	visibilityKnown = sample.visibilityKnown;
+	visible = sample.visible;
 }
 
-void Sample::ReplaceLight(const PointLight& newLight)
+void Sample::ReplaceLight(const PointLight& newLight, uint32_t newLightIndex)
 {
-	light = newLight;
+	lightIndex = newLightIndex;
 
-	lightDirection = light.position - hitPosition;
+	lightDirection = newLight.position - hitPosition;
 	lightDistance = glm::length(lightDirection);
 	lightDirection = glm::normalize(lightDirection);
 	BRDF = glm::dot(hitNormal, lightDirection);
+	visibilityKnown = false;
+	visible = false;
 
-	SetContribution();
+	SetContribution(newLight);
 }
 
 Resevoir::Resevoir() :
@@ -13,28 +13,35 @@ struct Sample
 	float hitDistance;
 	glm::vec3 hitPosition;
 	glm::vec3 hitNormal;
-	glm::vec3 hitPrevPosition;
-	glm::vec3 hitPrevNormal;
 	
 	float lightDistance;
 	glm::vec3 lightDirection;
-	PointLight light;
+	uint32_t lightIndex; // Index into the scene's light buffer
 
 	glm::vec3 cameraPosition;
 	float BRDF;
 
+	// Result of a shadow ray between hitPosition and the light, reset when either changes
+	bool visibilityKnown;
+	bool visible;
+
 	// ReSTIR
 	float weight;
 	float pdf;
 	float contribution;
 
 	Sample() = default;
-	Sample(const HitInfo& hitInfo, const glm::vec3& cameraOrigin, const PointLight& pointLight, float weight, float pdf);
+	Sample(const HitInfo& hitInfo, const glm::vec3& cameraOrigin, const PointLight& pointLight, uint32_t lightIndex, float weight, float pdf);
 	Sample(const Sample& sample, float weight);
 
-	void ReplaceLight(const PointLight& newLight);
+	void ReplaceLight(const PointLight& newLight, uint32_t newLightIndex);
+	void SetVisibility(bool isVisible)
+	{
+		visibilityKnown = true;
+		visible = isVisible;
+	}
 private:
-	void SetContribution()
+	void SetContribution(const PointLight& light)
 	{
 		contribution = CalcContribution((BRDF * light.emmission) / (lightDistance * lightDistance));
 	}
@@ -62,6 +69,7 @@ public:
 
 	Sample GetSample() const { return m_Sample; }
 	Sample& GetSampleRef() { return m_Sample; }
+	const Sample& GetSampleRef() const { return m_Sample; }
 	void SetSample(const Sample& sample) { m_Sample = sample; }
 
 	int GetSampleCount() const { return m_SampleCount; }
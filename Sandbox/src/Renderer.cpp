@@ -6,6 +6,8 @@
 #include "Utils.h"
 #include "TaskBatch.h"
 #include "RenderCommand.h"
+#include "PostProcessing.h"
+#include "ShadowRayBatch.h"
 
 // ================= Normal Rendering mode =================
 
@@ -18,7 +20,13 @@ namespace RenderModeNormal
 		tlas.Traverse(ray);
 		if (ray.hitInfo.hit)
 		{
-			glm::vec3 normal = settings.RenderPrevNormals ? ray.hitInfo.prevNormal : ray.hitInfo.normal;
+			glm::vec3 normal = ray.hitInfo.normal;
+			if (settings.RenderPrevNormals)
+			{
+				glm::vec3 prevPosition;
+				tlas.GetPrevHit(ray.hitInfo, prevPosition, normal);
+			}
+
 			E = 0.5f * normal + 0.5f;
 		}
 
@@ -42,6 +50,163 @@ namespace RenderModeTraversalSteps
 	}
 }
 
+// ================= Scene Snapshots =================
+
+void Renderer::SubmitScene(const Camera& camera, const TLAS& tlas, const LightBufferRef& lights)
+{
+	std::shared_ptr<SceneSnapshot> snapshot = std::make_shared<SceneSnapshot>();
+	const SceneSnapshotRef& published = m_PublishedSnapshot;
+	snapshot->version = published ? published->version + 1 : 1;
+	snapshot->camera = camera;
+	snapshot->lights = lights;
+
+	// Share what didn't change with the previous version
+	const std::vector<TLAS::Instance>& instances = tlas.GetInstances();
+	if (published && published->objects->size() == tlas.GetBLASCount())
+	{
+		snapshot->objects = published->objects;
+	}
+	else
+	{
+		std::shared_ptr<std::vector<std::shared_ptr<BLAS>>> objects = std::make_shared<std::vector<std::shared_ptr<BLAS>>>();
+		objects->reserve(tlas.GetBLASCount());
+		for (uint32_t i = 0; i < tlas.GetBLASCount(); i++)
+			objects->push_back(tlas.GetBLAS(i));
+
+		snapshot->objects = objects;
+	}
+
+	if (published && *published->instances == instances)
+		snapshot->instances = published->instances;
+	else
+		snapshot->instances = std::make_shared<const std::vector<TLAS::Instance>>(instances);
+
+	m_PublishedSnapshot = snapshot;
+	std::atomic_store(&m_LatestSnapshot, m_PublishedSnapshot);
+}
+
+void Renderer::ApplySceneSnapshot(const SceneSnapshotRef& snapshot, bool& viewChanged)
+{
+	const SceneSnapshot* applied = m_AppliedSnapshot.get();
+
+	// Runs every frame, motion is relative to the previous frame also when the UI submitted no new version since
+	m_PrevCamera = m_Scene.camera;
+	if (applied == nullptr || snapshot->version != applied->version)
+	{
+		m_Scene.camera = snapshot->camera;
+		m_Scene.camera.UpdateState();
+	}
+
+	// BLASes and instances are only ever added, the TLAS takes over the new ones
+	if (applied == nullptr || snapshot->objects != applied->objects)
+	{
+		for (uint32_t i = m_Scene.tlas.GetBLASCount(); i < snapshot->objects->size(); i++)
+			m_Scene.tlas.AddBLAS((*snapshot->objects)[i]);
+	}
+
+	bool instancesAdded = false;
+	if (applied == nullptr || snapshot->instances != applied->instances)
+	{
+		const std::vector<TLAS::Instance>& instances = *snapshot->instances;
+		instancesAdded = instances.size() > m_Scene.tlas.GetInstanceCount();
+		for (uint32_t i = 0; i < m_Scene.tlas.GetInstanceCount(); i++)
+		{
+			m_Scene.tlas.GetTransformRef(i) = instances[i].transform;
+			m_Scene.tlas.GetMaskRef(i) = instances[i].mask;
+		}
+
+		for (uint32_t i = m_Scene.tlas.GetInstanceCount(); i < instances.size(); i++)
+			m_Scene.tlas.AddInstance(instances[i].blasHandle, instances[i].transform, instances[i].mask);
+	}
+
+	// Also clears the motion of instances that stopped, without new transforms nothing moved this frame
+	m_Scene.tlas.Update();
+
+	// Resevoirs refer to lights by index, history from another light buffer is meaningless.
+	// The light samplers read the scene bounds, so they update after the TLAS.
+	bool lightsUpdated = m_Scene.lights->GetVersion() != snapshot->lights->GetVersion();
+	m_Scene.lights = snapshot->lights;
+	if (lightsUpdated)
+	{
+		UpdateLightSampler();
+		m_ValidHistory = false;
+		viewChanged = true;
+	}
+
+	const Camera& camera = m_Scene.camera;
+	viewChanged |= camera.position != m_PrevCamera.position || camera.rotation != m_PrevCamera.rotation || camera.verticalFOV != m_PrevCamera.verticalFOV;
+	viewChanged |= instancesAdded || m_Scene.tlas.InstancesChanged();
+
+	m_AppliedSnapshot = snapshot;
+}
+
+// ================= Light Sampling =================
+
+void Renderer::UpdateLightSampler()
+{
+	LightSampler::BuildPowerAliasTable(m_Scene.lights->GetPointLights(), m_LightAliasTable);
+	m_LightBVH.Update(m_Scene.lights->GetPointLights());
+}
+
+void Renderer::UpdateLightGrid(uint32_t seed)
+{
+	glm::vec3 sceneMin, sceneMax;
+	m_Scene.tlas.GetBounds(sceneMin, sceneMax);
+	m_LightGrid.Configure(sceneMin, sceneMax, m_Settings.GridResolution, m_Settings.GridResevoirsPerCell);
+
+	const uint32_t cellsPerTask = 64;
+	TaskBatch taskBatch(m_Settings.ThreadCount);
+	for (uint32_t firstCell = 0; firstCell < m_LightGrid.GetCellCount(); firstCell += cellsPerTask)
+	{
+		taskBatch.EnqueueTask([=]() { m_LightGrid.FillCells(firstCell, cellsPerTask, m_Scene.lights->GetPointLights(), m_LightAliasTable, m_Settings.GridCandidatesPerCell, seed + firstCell); });
+	}
+	taskBatch.ExecuteTasks();
+}
+
+void Renderer::UpdateLightHashGrid()
+{
+	const LightBuffer& lights = *m_Scene.lights;
+	glm::vec3 sceneMin, sceneMax;
+	m_Scene.tlas.GetBounds(sceneMin, sceneMax);
+	if (m_LightHashGrid.IsBuiltFor(lights.GetVersion(), sceneMin, sceneMax, m_Settings.CullingCellSize, m_Settings.InfluenceCutoff))
+		return;
+
+	m_LightHashGrid.Build(lights.GetPointLights(), lights.GetVersion(), sceneMin, sceneMax, m_Settings.CullingCellSize, m_Settings.InfluenceCutoff);
+}
+
+uint32_t Renderer::SampleLight(const HitInfo& hitInfo, const glm::vec2& random, float& pdf) const
+{
+	switch (m_Settings.LightSampling)
+	{
+	case RendererSettings::LightSamplingMode::Power:
+		return m_LightAliasTable.Sample(random, pdf);
+	case RendererSettings::LightSamplingMode::LightBVH:
+		return m_LightBVH.Sample(m_Scene.lights->GetPointLights(), hitInfo.position, hitInfo.normal, random.x, pdf);
+	case RendererSettings::LightSamplingMode::ReGIR:
+	{
+		uint32_t lightIndex;
+		if (m_LightGrid.Sample(hitInfo.position, random.x, lightIndex, pdf))
+			return lightIndex;
+
+		// Outside of the grid
+		return m_LightAliasTable.Sample(random, pdf);
+	}
+	case RendererSettings::LightSamplingMode::Culled:
+	{
+		// No light reaches the cell, the candidate is dropped through its zero pdf
+		uint32_t lightIndex = 0;
+		if (!m_LightHashGrid.Sample(hitInfo.position, random.x, lightIndex, pdf))
+			pdf = 0.0f;
+
+		return lightIndex;
+	}
+	default:
+		uint32_t lightCount = m_Scene.lights->GetCount();
+		pdf = 1.0f / lightCount;
+		return std::min(static_cast<uint32_t>(random.x * lightCount), lightCount - 1);
+	}
+}
+
 // ================= Next Event estimation DI rendering mode =================
 
 glm::vec4 Renderer::RenderDI(Ray& ray, uint32_t& seed)
@@ -60,7 +225,7 @@ glm::vec4 Renderer::RenderDI(Ray& ray, uint32_t& seed)
 
 		if (glm::dot(ray.hitInfo.normal, lightDirection) > 0)
 		{
-			Ray shadowRay = Ray(ray.hitInfo.position + (m_Settings.Eta * lightDirection), lightDirection, lightDistance - 2 * m_Settings.Eta);
+			Ray shadowRay = Ray(ray.hitInfo.position + (m_Settings.Eta * lightDirection), lightDirection, lightDistance - 2 * m_Settings.Eta, RayMaskShadow);
 			bool lightOccluded = m_Scene.tlas.IsOccluded(shadowRay);
 			if (!lightOccluded || !m_Settings.OcclusionCheckDI)
 			{
@@ -75,20 +240,22 @@ glm::vec4 Renderer::RenderDI(Ray& ray, uint32_t& seed)
 
 	if (m_Settings.SampleAllLightsDI)
 	{
-		for (int i = 0; i < m_Scene.pointLights.size(); i++)
+		for (const PointLight& pointLight : m_Scene.lights->GetPointLights())
 		{
-			E += CalcLightContribution(ray, m_Scene.pointLights[i]);
+			E += CalcLightContribution(ray, pointLight);
 		}
 	}
 	else {
 		for (int i = 0; i < m_Settings.CandidateCountDI; i++)
 		{
-			int index = Utils::RandomInt(0, m_Scene.pointLights.size(), seed);
-			PointLight randomPointLight = m_Scene.pointLights[index];
-			E += CalcLightContribution(ray, randomPointLight);
+			float lightPdf;
+			glm::vec2 random(Utils::RandomFloat(seed), Utils::RandomFloat(seed));
+			uint32_t index = SampleLight(ray.hitInfo, random, lightPdf);
+			if (lightPdf > 0.0f)
+				E += CalcLightContribution(ray, m_Scene.lights->GetLight(index)) / lightPdf;
 		}
 
-		E *= m_Scene.pointLights.size() / m_Settings.CandidateCountDI;
+		E /= static_cast<float>(m_Settings.CandidateCountDI);
 	}
 
 	return glm::vec4(E, 1.0f);
@@ -96,19 +263,144 @@ glm::vec4 Renderer::RenderDI(Ray& ray, uint32_t& seed)
 
 // ================= ReSTIR rendering mode =================
 
-void Renderer::GenerateSample(const glm::i32vec2 pixel, uint32_t bufferIndex, uint32_t& seed)
+void Renderer::TracePrimaryRay(const glm::i32vec2 pixel, uint32_t bufferIndex)
+{
+	Ray ray = m_Scene.camera.GetRay(pixel.x, pixel.y);
+	m_Scene.tlas.Traverse(ray);
+	m_PrimaryHitBuffer[bufferIndex] = ray.hitInfo;
+}
+
+void Renderer::TracePrimaryBlock(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, uint32_t width)
+{
+	// Partial blocks at the frame edges don't fill a packet and use single rays, as does the
+	// TraversalSteps mode since packet hits carry no traversal steps
+	bool fullPacket = xMax - xMin == TLAS::PacketWidth && yMax - yMin == TLAS::PacketWidth;
+	bool countSteps = m_Settings.Mode == RendererSettings::RenderMode::TraversalSteps;
+	if (!m_Settings.PacketPrimaryRays || !fullPacket || countSteps)
+	{
+		for (uint32_t y = yMin; y < yMax; y++)
+		{
+			uint32_t yOffset = y * width;
+			for (uint32_t x = xMin; x < xMax; x++)
+			{
+				TracePrimaryRay(glm::i32vec2(x, y), x + yOffset);
+				WritePixelMotion(glm::i32vec2(x, y), x + yOffset);
+			}
+		}
+		return;
+	}
+
+	Ray packet[TLAS::PacketSize];
+	for (uint32_t y = 0; y < TLAS::PacketWidth; y++)
+	{
+		for (uint32_t x = 0; x < TLAS::PacketWidth; x++)
+		{
+			packet[TLAS::GetPacketIndex(x, y)] = m_Scene.camera.GetRay(xMin + x, yMin + y);
+		}
+	}
+
+	m_Scene.tlas.TraversePacket(packet);
+
+	for (uint32_t y = 0; y < TLAS::PacketWidth; y++)
+	{
+		uint32_t yOffset = (yMin + y) * width;
+		for (uint32_t x = 0; x < TLAS::PacketWidth; x++)
+		{
+			m_PrimaryHitBuffer[xMin + x + yOffset] = packet[TLAS::GetPacketIndex(x, y)].hitInfo;
+			WritePixelMotion(glm::i32vec2(xMin + x, yMin + y), xMin + x + yOffset);
+		}
+	}
+}
+
+void Renderer::WritePixelMotion(const glm::i32vec2 pixel, uint32_t bufferIndex)
+{
+	const HitInfo& hitInfo = m_PrimaryHitBuffer[bufferIndex];
+	PixelMotion& pixelMotion = m_MotionBuffer[bufferIndex];
+
+	if (!hitInfo.hit)
+	{
+		pixelMotion = PixelMotion();
+		return;
+	}
+
+	m_Scene.tlas.GetPrevHit(hitInfo, pixelMotion.prevPosition, pixelMotion.prevNormal);
+	glm::vec2 pixelCenter = glm::vec2(pixel) + 0.5f;
+	pixelMotion.motionVector = m_PrevCamera.WorldSpaceToScreenSpace(pixelMotion.prevPosition) - pixelCenter;
+}
+
+float Renderer::GetRequestedCandidateCount(const glm::i32vec2 pixel, uint32_t bufferIndex)
+{
+	float minCount = static_cast<float>(m_Settings.MinCandidateCountReSTIR);
+	float maxCount = static_cast<float>(std::max(m_Settings.MinCandidateCountReSTIR, m_Settings.MaxCandidateCountReSTIR));
+
+	const HitInfo& hitInfo = m_PrimaryHitBuffer[bufferIndex];
+	if (!hitInfo.hit)
+		return minCount;
+
+	// Pixels without usable history get the full count
+	const PixelMotion& pixelMotion = m_MotionBuffer[bufferIndex];
+	glm::i32vec2 prevPixel = glm::i32vec2(glm::floor(glm::vec2(pixel) + 0.5f + pixelMotion.motionVector));
+	bool withinFrame = prevPixel.x >= 0 && prevPixel.y >= 0 && prevPixel.x < m_PrevRenderResolution.x && prevPixel.y < m_PrevRenderResolution.y;
+	if (!withinFrame || !m_ValidHistory)
+		return maxCount;
+
+	const Resevoir& prevResevoir = m_ResevoirBuffers.GetPrevBuffer()[prevPixel.x + prevPixel.y * m_PrevRenderResolution.x];
+	const Sample& prevSample = prevResevoir.GetSampleRef();
+	float cameraDistance = glm::length(hitInfo.position - m_Scene.camera.position);
+	float scaledMaxDistance = m_Settings.TemporalMaxDistance + (cameraDistance * m_Settings.TemporalMaxDistanceDepthScaling);
+	bool disoccluded = !prevSample.hit || glm::length(prevSample.hitPosition - pixelMotion.prevPosition) > scaledMaxDistance ||
+		glm::dot(prevSample.hitNormal, pixelMotion.prevNormal) < m_Settings.TemporalMinNormalSimilarity;
+	if (disoccluded)
+		return maxCount;
+
+	// Converged pixels have a long history and a stable weight
+	const PixelStatistics& statistics = m_StatisticsBuffer[bufferIndex];
+	float convergedSampleCount = static_cast<float>(m_Settings.TemporalSampleCountRatio * m_Settings.CandidateCountReSTIR);
+	float historyLength = std::min(prevResevoir.GetSampleCount() / convergedSampleCount, 1.0f);
+	float meanSquared = statistics.meanWeight * statistics.meanWeight;
+	float relativeVariance = std::max(statistics.meanWeightSquared - meanSquared, 0.0f) / std::max(meanSquared, 0.0001f);
+
+	float noise = std::min((1.0f - historyLength) + relativeVariance, 1.0f);
+	return minCount + (maxCount - minCount) * noise;
+}
+
+void Renderer::UpdatePixelStatistics(uint32_t bufferIndex)
+{
+	float weight = m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex].WeightSampleOut;
+	if (!std::isfinite(weight))
+		weight = 0.0f;
+
+	PixelStatistics& statistics = m_StatisticsBuffer[bufferIndex];
+	if (!m_ValidHistory)
+	{
+		statistics.meanWeight = weight;
+		statistics.meanWeightSquared = weight * weight;
+		return;
+	}
+
+	// Exponential moving average over roughly the last ten frames
+	const float blend = 0.1f;
+	statistics.meanWeight += blend * (weight - statistics.meanWeight);
+	statistics.meanWeightSquared += blend * (weight * weight - statistics.meanWeightSquared);
+}
+
+void Renderer::GenerateSample(const glm::i32vec2 pixel, uint32_t bufferIndex, uint32_t candidateCount, uint32_t& seed)
 {
 	Resevoir resevoir;
 	Sample sample;
 
-	for (int i = 0; i < m_Settings.CandidateCountReSTIR; i++)
+	// All candidates share the primary hit, only the light evaluation differs
+	const HitInfo& hitInfo = m_PrimaryHitBuffer[bufferIndex];
+	PixelSampler sampler = GetPixelSampler(pixel, CandidateSamplerDimension, seed);
+
+	for (uint32_t i = 0; i < candidateCount; i++)
 	{
-		PointLight randomPointLight = m_Scene.pointLights[Utils::RandomInt(0, m_Scene.pointLights.size(), seed)];
-		Ray ray = m_Scene.camera.GetRay(pixel.x, pixel.y);
-		m_Scene.tlas.Traverse(ray);
+		float lightPdf;
+		uint32_t lightIndex = SampleLight(hitInfo, sampler.Get2D(), lightPdf);
 
-		sample = Sample(ray.hitInfo, m_Scene.camera.position, randomPointLight, m_Scene.pointLights.size(), 1.0f / m_Scene.pointLights.size());
-		float weight = sample.contribution / sample.pdf;
+		// Lights that can't reach the surface have a zero pdf and still count as a candidate
+		sample = Sample(hitInfo, m_Scene.camera.position, m_Scene.lights->GetLight(lightIndex), lightIndex, lightPdf > 0.0f ? 1.0f / lightPdf : 0.0f, lightPdf);
+		float weight = lightPdf > 0.0f ? sample.contribution / sample.pdf : 0.0f;
 		resevoir.Update(sample, weight, seed);
 	}
 
@@ -116,74 +408,190 @@ void Renderer::GenerateSample(const glm::i32vec2 pixel, uint32_t bufferIndex, ui
 	m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex] = resevoir;
 }
 
-void Renderer::VisibilityPass(uint32_t bufferIndex)
+void Renderer::VisibilityPass(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, uint32_t width)
 {
-	Resevoir& resevoir = m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex];
-	const Sample& sample = m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex].GetSampleRef();
+	std::vector<Resevoir>& resevoirs = m_ResevoirBuffers.GetCurrentBuffer();
 
-	if (!sample.hit || glm::dot(glm::normalize(sample.lightDirection), sample.hitNormal) < 0.001f)
+	ShadowRayBatch shadowRays;
+	shadowRays.Reserve((xMax - xMin) * (yMax - yMin));
+
+	for (uint32_t y = yMin; y < yMax; y++)
 	{
-		resevoir.WeightSampleOut = 0.0f;
-		return;
+		for (uint32_t x = xMin; x < xMax; x++)
+		{
+			if (m_VariableRateActive && !IsPixelShaded(x, y))
+				continue;
+
+			uint32_t bufferIndex = x + y * width;
+			Resevoir& resevoir = resevoirs[bufferIndex];
+			Sample& sample = resevoir.GetSampleRef();
+
+			if (!sample.hit || glm::dot(glm::normalize(sample.lightDirection), sample.hitNormal) < 0.001f)
+			{
+				resevoir.WeightSampleOut = 0.0f;
+				sample.SetVisibility(false);
+				continue;
+			}
+
+			shadowRays.Add(sample.hitPosition, m_Scene.lights->GetLight(sample.lightIndex).position, sample.lightIndex, m_Settings.Eta, bufferIndex);
+		}
 	}
 
-	glm::vec3 rayOrigin = sample.hitPosition + m_Settings.Eta * sample.lightDirection;
-	Ray shadowRay = Ray(rayOrigin, sample.lightDirection, sample.lightDistance - 2.0f * m_Settings.Eta);
+	shadowRays.Trace(m_Scene.tlas);
+	m_ShadowRayCount += shadowRays.GetRayCount();
 
-	if (m_Scene.tlas.IsOccluded(shadowRay))
-		resevoir.WeightSampleOut = 0.0f;
+	for (uint32_t i = 0; i < shadowRays.GetRayCount(); i++)
+	{
+		Resevoir& resevoir = resevoirs[shadowRays.GetPayload(i)];
+		bool occluded = shadowRays.IsOccluded(i);
+		resevoir.GetSampleRef().SetVisibility(!occluded);
+
+		if (occluded)
+			resevoir.WeightSampleOut = 0.0f;
+	}
 }
 
-void Renderer::TemporalReuse(const glm::i32vec2& pixel, const glm::i32vec2 resolution, uint32_t bufferIndex, uint32_t& seed)
+bool Renderer::FindTemporalCandidate(const glm::i32vec2& resolution, uint32_t bufferIndex, uint32_t& seed, uint32_t& prevIndex)
 {
-	const Resevoir& pixelResevoir = m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex];
-	Sample pixelSample = pixelResevoir.GetSample();
-
-	glm::i32vec2 prevPixel = m_PrevCamera.WorldSpaceToScreenSpace(pixelSample.hitPrevPosition, seed);
-	bool withinFrame = prevPixel.x >= 0 && prevPixel.y >= 0 && prevPixel.x < resolution.x && prevPixel.y < resolution.y;
+	const Sample& pixelSample = m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex].GetSampleRef();
+	const PixelMotion& pixelMotion = m_MotionBuffer[bufferIndex];
+	if (!pixelSample.hit)
+		return false;
+
+	// Jittering before rounding down picks one of the nearest previous pixels with bilinear probability
+	glm::i32vec2 pixel = glm::i32vec2(bufferIndex % resolution.x, bufferIndex / resolution.x);
+	glm::vec2 pixelCenter = glm::vec2(pixel) + 0.5f;
+	glm::vec2 jitter = GetPixelSampler(pixel, TemporalSamplerDimension, seed).Get2D() - 0.5f;
+	glm::i32vec2 prevPixel = glm::i32vec2(glm::floor(pixelCenter + pixelMotion.motionVector + jitter));
+	bool withinFrame = prevPixel.x >= 0 && prevPixel.y >= 0 && prevPixel.x < m_PrevRenderResolution.x && prevPixel.y < m_PrevRenderResolution.y;
 	if (!withinFrame || !m_ValidHistory)
-		return;
+		return false;
 
-	Resevoir& prevResevoir = m_ResevoirBuffers.GetPrevBuffer()[prevPixel.x + prevPixel.y * resolution.x];
+	prevIndex = prevPixel.x + prevPixel.y * m_PrevRenderResolution.x;
+	const Resevoir& prevResevoir = m_ResevoirBuffers.GetPrevBuffer()[prevIndex];
 	const Sample& prevSample = prevResevoir.GetSample();
 
 	if (!prevSample.hit)
-		return;
+		return false;
 
 	float cameraDistance = glm::length(pixelSample.hitPosition - m_Scene.camera.position);
 	// Grow maxDistance with camera distance to make sure distant pixels don't always exceed maxDistance
 	float scaledMaxDistance = m_Settings.TemporalMaxDistance + (cameraDistance * m_Settings.TemporalMaxDistanceDepthScaling);
-	bool withinMaxDistance = glm::length(prevSample.hitPosition - pixelSample.hitPrevPosition) <= scaledMaxDistance;
-	bool sameNormals = glm::dot(prevSample.hitNormal, pixelSample.hitPrevNormal) >= m_Settings.TemporalMinNormalSimilarity;
+	bool withinMaxDistance = glm::length(prevSample.hitPosition - pixelMotion.prevPosition) <= scaledMaxDistance;
+	bool sameNormals = glm::dot(prevSample.hitNormal, pixelMotion.prevNormal) >= m_Settings.TemporalMinNormalSimilarity;
+
+	return withinMaxDistance && sameNormals && prevResevoir.WeightSampleOut > 0.01f;
+}
+
+void Renderer::CombineTemporalCandidate(uint32_t bufferIndex, uint32_t prevIndex, bool visibilityTraced, uint32_t& seed)
+{
+	const Resevoir& pixelResevoir = m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex];
+	Sample pixelSample = pixelResevoir.GetSample();
+
+	Resevoir& prevResevoir = m_ResevoirBuffers.GetPrevBuffer()[prevIndex];
+	const Sample& prevSample = prevResevoir.GetSampleRef();
+
+	// Limit Temporal propogation
+	prevResevoir.SetSampleCount(std::min(m_Settings.TemporalSampleCountRatio * pixelResevoir.GetSampleCount(), prevResevoir.GetSampleCount()));
+
+	Resevoir temporalResevoir = Resevoir::CombineBiased(pixelResevoir, prevResevoir, seed);
+	const Sample& combinedSample = temporalResevoir.GetSampleRef();
+	if (combinedSample.lightIndex != pixelSample.lightIndex)
+		pixelSample.ReplaceLight(m_Scene.lights->GetLight(combinedSample.lightIndex), combinedSample.lightIndex);
+
+	// The previous light was just traced unoccluded from this hit
+	if (visibilityTraced && pixelSample.lightIndex == prevSample.lightIndex)
+		pixelSample.SetVisibility(true);
 
-	glm::vec3 shadowRayDirection = prevSample.light.position - pixelSample.hitPosition;
-	float shadowRayDistance = glm::length(shadowRayDirection);
-	shadowRayDirection = glm::normalize(shadowRayDirection);
-	glm::vec3 shadowRayOrigin = pixelSample.hitPosition + m_Settings.Eta * shadowRayDirection;
-	bool notOccluded = !m_Scene.tlas.IsOccluded(Ray(shadowRayOrigin, shadowRayDirection, shadowRayDistance - 2 * m_Settings.Eta));
+	temporalResevoir.SetSample(pixelSample);
+	m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex] = temporalResevoir;
+}
+
+void Renderer::TemporalReuse(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, const glm::i32vec2& resolution, uint32_t& seed)
+{
+	const std::vector<Resevoir>& resevoirs = m_ResevoirBuffers.GetCurrentBuffer();
+	const std::vector<Resevoir>& prevResevoirs = m_ResevoirBuffers.GetPrevBuffer();
 
-	if (withinMaxDistance && sameNormals && notOccluded && prevResevoir.WeightSampleOut > 0.01f)
+	// Geometric tests first, the shadow rays of all accepted candidates are traced together
+	std::vector<ReuseCandidate> candidates;
+	candidates.reserve((xMax - xMin) * (yMax - yMin));
+	ShadowRayBatch shadowRays;
+	shadowRays.Reserve((xMax - xMin) * (yMax - yMin));
+
+	for (uint32_t y = yMin; y < yMax; y++)
 	{
-		// Limit Temporal propogation
-		prevResevoir.SetSampleCount(std::min(m_Settings.TemporalSampleCountRatio * pixelResevoir.GetSampleCount(), prevResevoir.GetSampleCount()));
+		for (uint32_t x = xMin; x < xMax; x++)
+		{
+			uint32_t bufferIndex = x + y * resolution.x;
+			uint32_t prevIndex;
+			if (!FindTemporalCandidate(resolution, bufferIndex, seed, prevIndex))
+				continue;
 
-		Resevoir temporalResevoir = Resevoir::CombineBiased(pixelResevoir, prevResevoir, seed);
-		pixelSample.ReplaceLight(temporalResevoir.GetSample().light);
-		temporalResevoir.SetSample(pixelSample);
-		m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex] = temporalResevoir;
+			if (m_VariableRateActive && !IsPixelShaded(x, y))
+			{
+				CarryTemporalResevoir(bufferIndex, prevIndex);
+				continue;
+			}
+
+			// Merge on geometry alone, shading resolves the visibility of the selected sample
+			if (m_Settings.DeferredReuseVisibility)
+			{
+				CombineTemporalCandidate(bufferIndex, prevIndex, false, seed);
+				continue;
+			}
+
+			const Sample& prevSample = prevResevoirs[prevIndex].GetSampleRef();
+			shadowRays.Add(resevoirs[bufferIndex].GetSampleRef().hitPosition, m_Scene.lights->GetLight(prevSample.lightIndex).position, prevSample.lightIndex, m_Settings.Eta, candidates.size());
+			candidates.push_back({ bufferIndex, prevIndex });
+		}
+	}
+
+	shadowRays.Trace(m_Scene.tlas);
+	m_ShadowRayCount += shadowRays.GetRayCount();
+
+	for (uint32_t i = 0; i < shadowRays.GetRayCount(); i++)
+	{
+		if (shadowRays.IsOccluded(i))
+			continue;
+
+		const ReuseCandidate& candidate = candidates[shadowRays.GetPayload(i)];
+		CombineTemporalCandidate(candidate.bufferIndex, candidate.candidateIndex, true, seed);
 	}
 }
 
-void Renderer::CombineNeighbourPixel(Resevoir& pixelResevoir, const glm::i32vec2 pixel, const glm::i32vec2& resolution, uint32_t& seed)
+void Renderer::UpdateNeighbourOffsets(uint32_t seed)
 {
-	Sample pixelSample = pixelResevoir.GetSample();
+	// R2 sequence mapped onto a disk of SpatialPixelRadius, randomly rotated every frame
+	const float g = 1.32471795724474602596f;
+	const glm::vec2 alpha = glm::vec2(1.0f / g, 1.0f / (g * g));
+	float maxRadius = static_cast<float>(std::max(m_Settings.SpatialPixelRadius, 1));
+	float rotation = Utils::RandomFloat(seed) * 2.0f * glm::pi<float>();
+
+	m_NeighbourOffsets.resize(NeighbourOffsetCount);
+	for (uint32_t i = 0; i < NeighbourOffsetCount; i++)
+	{
+		glm::vec2 point = glm::fract(0.5f + alpha * static_cast<float>(i + 1));
+
+		// Radius starts at one pixel so no offset rounds to the pixel itself
+		float radius = 1.0f + (maxRadius - 1.0f) * std::sqrt(point.x);
+		float angle = rotation + point.y * 2.0f * glm::pi<float>();
+		m_NeighbourOffsets[i] = glm::i32vec2(glm::round(radius * glm::vec2(std::cos(angle), std::sin(angle))));
+	}
+}
+
+bool Renderer::FindNeighbourCandidate(const Sample& pixelSample, const glm::i32vec2 pixel, const glm::i32vec2& resolution, uint32_t offsetIndex, uint32_t& neighbourIndex)
+{
+	// Clamping keeps border pixels in the frame, a clamped offset can land back on the pixel itself
+	glm::i32vec2 neighbourPixel = glm::clamp(pixel + m_NeighbourOffsets[offsetIndex & (NeighbourOffsetCount - 1)], glm::i32vec2(0), resolution - 1);
+	neighbourIndex = neighbourPixel.x + neighbourPixel.y * resolution.x;
+	if (neighbourPixel == pixel)
+		return false;
 
-	glm::i32vec2 neighbourPixel = Utils::GetNeighbourPixel(pixel, resolution, m_Settings.SpatialPixelRadius, seed);
-	Resevoir& neighbourResevoir = m_ResevoirBuffers.GetCurrentBuffer()[neighbourPixel.x + neighbourPixel.y * resolution.x];
-	const Sample& neighbourSample = neighbourResevoir.GetSampleRef();
+	const Resevoir& neighbourResevoir = m_ResevoirBuffers.GetCurrentBuffer()[neighbourIndex];
+	const Sample& neighbourSample = neighbourResevoir.GetSample();
 
 	if (!neighbourSample.hit)
-		return;
+		return false;
 
 	float cameraDistance = glm::length(pixelSample.hitPosition - m_Scene.camera.position);
 	// Grow maxDistance with camera distance to make sure distant pixels don't always exceed maxDistance
@@ -191,52 +599,350 @@ void Renderer::CombineNeighbourPixel(Resevoir& pixelResevoir, const glm::i32vec2
 	bool withinMaxDistance = glm::length(neighbourSample.hitPosition - pixelSample.hitPosition) <= scaledMaxDistance;
 	bool sameNormals = glm::dot(pixelSample.hitNormal, neighbourSample.hitNormal) >= m_Settings.SpatialMinNormalSimilarity;
 
-	glm::vec3 shadowRayDirection = neighbourSample.light.position - pixelSample.hitPosition;
-	float shadowRayDistance = glm::length(shadowRayDirection);
-	shadowRayDirection = glm::normalize(shadowRayDirection);
-	glm::vec3 shadowRayOrigin = pixelSample.hitPosition + m_Settings.Eta * shadowRayDirection;
-	bool notOccluded = !m_Scene.tlas.IsOccluded(Ray(shadowRayOrigin, shadowRayDirection, shadowRayDistance - 2 * m_Settings.Eta));
+	return withinMaxDistance && sameNormals && neighbourResevoir.WeightSampleOut > 0.01f;
+}
+
+void Renderer::CombineNeighbourPixel(Resevoir& pixelResevoir, uint32_t neighbourIndex, bool visibilityTraced, uint32_t& seed)
+{
+	Sample pixelSample = pixelResevoir.GetSample();
+
+	const Resevoir& neighbourResevoir = m_ResevoirBuffers.GetCurrentBuffer()[neighbourIndex];
+	const Sample& neighbourSample = neighbourResevoir.GetSample();
 
-	Resevoir spatialResevoir;
-	if (withinMaxDistance && sameNormals && notOccluded && neighbourResevoir.WeightSampleOut > 0.01f)
+	Resevoir spatialResevoir = Resevoir::CombineBiased(pixelResevoir, neighbourResevoir, seed);
+	const Sample& combinedSample = spatialResevoir.GetSampleRef();
+	if (combinedSample.lightIndex != pixelSample.lightIndex)
+		pixelSample.ReplaceLight(m_Scene.lights->GetLight(combinedSample.lightIndex), combinedSample.lightIndex);
+
+	// The neighbour light was just traced unoccluded from this hit
+	if (visibilityTraced && pixelSample.lightIndex == neighbourSample.lightIndex)
+		pixelSample.SetVisibility(true);
+
+	spatialResevoir.SetSample(pixelSample);
+	pixelResevoir = spatialResevoir;
+}
+
+void Renderer::SpatialReuse(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, const glm::i32vec2& resolution, uint32_t& seed)
+{
+	const std::vector<Resevoir>& resevoirs = m_ResevoirBuffers.GetCurrentBuffer();
+	std::vector<Resevoir>& spatialResevoirs = m_ResevoirBuffers.GetSpatialReuseBuffer();
+
+	// Neighbours are tested against the hit of the pixel, which merging doesn't change,
+	// so every neighbour of the tile can be selected and traced before the first merge
+	uint32_t spatialInterval = std::max(m_Settings.SpatialReuseInterval, 1);
+	uint32_t maxCandidates = (xMax - xMin) * (yMax - yMin) * std::max(m_Settings.SpatialReuseNeighbours, 0) / spatialInterval + 1;
+	std::vector<ReuseCandidate> candidates;
+	candidates.reserve(maxCandidates);
+	ShadowRayBatch shadowRays;
+	shadowRays.Reserve(maxCandidates);
+
+	for (uint32_t y = yMin; y < yMax; y++)
+	{
+		for (uint32_t x = xMin; x < xMax; x++)
+		{
+			uint32_t bufferIndex = x + y * resolution.x;
+			spatialResevoirs[bufferIndex] = resevoirs[bufferIndex];
+
+			// Reduced rate reuse, the pattern shifts every frame and skipped pixels keep their temporal result
+			if ((x + y + m_FrameIndex) % spatialInterval != 0 || (m_VariableRateActive && !IsPixelShaded(x, y)))
+				continue;
+
+			const Sample& pixelSample = resevoirs[bufferIndex].GetSampleRef();
+
+			// Consecutive entries of the offset table are well spread, start at a random one per pixel
+			float offsetRandom = GetPixelSampler(glm::i32vec2(x, y), SpatialSamplerDimension, seed).Get1D();
+			uint32_t firstOffset = static_cast<uint32_t>(offsetRandom * NeighbourOffsetCount);
+			for (int i = 0; i < m_Settings.SpatialReuseNeighbours; i++)
+			{
+				uint32_t neighbourIndex;
+				if (!FindNeighbourCandidate(pixelSample, glm::i32vec2(x, y), resolution, firstOffset + i, neighbourIndex))
+					continue;
+
+				if (m_Settings.DeferredReuseVisibility)
+				{
+					CombineNeighbourPixel(spatialResevoirs[bufferIndex], neighbourIndex, false, seed);
+					continue;
+				}
+
+				const Sample& neighbourSample = resevoirs[neighbourIndex].GetSampleRef();
+				shadowRays.Add(pixelSample.hitPosition, m_Scene.lights->GetLight(neighbourSample.lightIndex).position, neighbourSample.lightIndex, m_Settings.Eta, candidates.size());
+				candidates.push_back({ bufferIndex, neighbourIndex });
+			}
+		}
+	}
+
+	shadowRays.Trace(m_Scene.tlas);
+	m_ShadowRayCount += shadowRays.GetRayCount();
+
+	// Merge in candidate order, so each pixel combines its neighbours in the order they were picked
+	for (uint32_t i = 0; i < shadowRays.GetRayCount(); i++)
 	{
-		spatialResevoir = Resevoir::CombineBiased(pixelResevoir, neighbourResevoir, seed);
-		pixelSample.ReplaceLight(spatialResevoir.GetSample().light);
-		spatialResevoir.SetSample(pixelSample);
-		pixelResevoir = spatialResevoir;
+		if (shadowRays.IsOccluded(i))
+			continue;
+
+		const ReuseCandidate& candidate = candidates[shadowRays.GetPayload(i)];
+		CombineNeighbourPixel(spatialResevoirs[candidate.bufferIndex], candidate.candidateIndex, true, seed);
 	}
 }
 
-void Renderer::SpatialReuse(const glm::i32vec2& pixel, const glm::i32vec2& resolution, uint32_t bufferIndex, uint32_t& seed)
+void Renderer::ShadingPass(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, uint32_t width)
 {
-	m_ResevoirBuffers.GetSpatialReuseBuffer()[bufferIndex] = m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex];
+	const std::vector<Resevoir>& resevoirs = m_ResevoirBuffers.GetCurrentBuffer();
+
+	ShadowRayBatch shadowRays;
+	shadowRays.Reserve((xMax - xMin) * (yMax - yMin));
+
+	for (uint32_t y = yMin; y < yMax; y++)
+	{
+		for (uint32_t x = xMin; x < xMax; x++)
+		{
+			// Skipped pixels are filled in by the reconstruction pass
+			if (m_VariableRateActive && !IsPixelShaded(x, y))
+				continue;
+
+			uint32_t bufferIndex = x + y * width;
+			if (m_Settings.AdaptiveCandidateCount)
+				UpdatePixelStatistics(bufferIndex);
+
+			const Sample& sample = resevoirs[bufferIndex].GetSampleRef();
+			bool facesLight = sample.BRDF > 0.001f;
+
+			// Only trace when no earlier pass tested this hit and light combination
+			if (facesLight && !sample.visibilityKnown)
+				shadowRays.Add(sample.hitPosition, m_Scene.lights->GetLight(sample.lightIndex).position, sample.lightIndex, m_Settings.Eta, bufferIndex);
+			else
+				m_HDRBuffer[bufferIndex] = ShadeSample(resevoirs[bufferIndex], facesLight && sample.visible);
+		}
+	}
+
+	shadowRays.Trace(m_Scene.tlas);
+	m_ShadowRayCount += shadowRays.GetRayCount();
 
-	CombineNeighbourPixel(m_ResevoirBuffers.GetSpatialReuseBuffer()[bufferIndex], pixel, resolution, seed);
-	for (int i = 1; i < m_Settings.SpatialReuseNeighbours; i++)
+	for (uint32_t i = 0; i < shadowRays.GetRayCount(); i++)
 	{
-		CombineNeighbourPixel(m_ResevoirBuffers.GetSpatialReuseBuffer()[bufferIndex], pixel, resolution, seed);
+		uint32_t bufferIndex = shadowRays.GetPayload(i);
+		m_HDRBuffer[bufferIndex] = ShadeSample(resevoirs[bufferIndex], !shadowRays.IsOccluded(i));
 	}
 }
 
-glm::vec4 Renderer::RenderSample(uint32_t bufferIndex, uint32_t& seed)
+glm::vec4 Renderer::ShadeSample(const Resevoir& resevoir, bool visible) const
 {
 	// Direct lighting calculation
 	glm::vec3 outputColor(0.0f);
-	Resevoir resevoir = m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex];
-	Sample sample = resevoir.GetSample();
+	const Sample& sample = resevoir.GetSampleRef();
+
+	if (visible)
+	{
+		outputColor = sample.BRDF * m_Scene.lights->GetLight(sample.lightIndex).emmission / (sample.lightDistance * sample.lightDistance);
+	}
+
+	return glm::vec4(outputColor * resevoir.WeightSampleOut, 1.0f);
+}
+
+// ================= Variable Rate Shading =================
+
+bool Renderer::IsPixelShaded(uint32_t x, uint32_t y) const
+{
+	uint32_t tilesPerRow = (m_ShadingRateResolution.x + ShadingRateTileSize - 1) / ShadingRateTileSize;
+	ShadingRate shadingRate = m_ShadingRates[(x / ShadingRateTileSize) + (y / ShadingRateTileSize) * tilesPerRow];
 
-	if (sample.BRDF > 0.001f)
+	// The shaded pixels rotate every frame, so every pixel is shaded every 2 or 4 frames
+	switch (shadingRate)
 	{
-		glm::vec3 shadowRayOrigin = sample.hitPosition + (m_Settings.Eta * sample.lightDirection);
-		Ray shadowRay = Ray(shadowRayOrigin, sample.lightDirection, sample.lightDistance - 2.0f * m_Settings.Eta);
+	case ShadingRate::Half:
+		return ((x + y + m_FrameIndex) & 1) == 0;
+	case ShadingRate::Quarter:
+	{
+		// Diagonal pixels of the 2x2 block follow each other
+		static const uint32_t blockOrder[4] = { 0, 3, 1, 2 };
+		return (x & 1) + 2 * (y & 1) == blockOrder[m_FrameIndex & 3];
+	}
+	default:
+		return true;
+	}
+}
+
+void Renderer::SkipSample(uint32_t bufferIndex)
+{
+	// An empty resevoir that knows its hit, temporal reuse carries the previous resevoir onto it
+	const HitInfo& hitInfo = m_PrimaryHitBuffer[bufferIndex];
+	Resevoir resevoir;
+	resevoir.SetSample(Sample(hitInfo, m_Scene.camera.position, m_Scene.lights->GetLight(0), 0, 0.0f, 0.0f));
+	m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex] = resevoir;
+}
+
+void Renderer::CarryTemporalResevoir(uint32_t bufferIndex, uint32_t prevIndex)
+{
+	Resevoir& pixelResevoir = m_ResevoirBuffers.GetCurrentBuffer()[bufferIndex];
+	Sample pixelSample = pixelResevoir.GetSample();
 
-		if (!m_Scene.tlas.IsOccluded(shadowRay))
+	const Resevoir& prevResevoir = m_ResevoirBuffers.GetPrevBuffer()[prevIndex];
+	pixelSample.ReplaceLight(m_Scene.lights->GetLight(prevResevoir.GetSampleRef().lightIndex), prevResevoir.GetSampleRef().lightIndex);
+
+	// Weight and sample count move along unchanged, like the light of a temporal merge
+	Resevoir carriedResevoir = prevResevoir;
+	carriedResevoir.SetSample(pixelSample);
+	pixelResevoir = carriedResevoir;
+}
+
+void Renderer::ReconstructionPass(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, const glm::i32vec2& resolution)
+{
+	const std::vector<Resevoir>& resevoirs = m_ResevoirBuffers.GetCurrentBuffer();
+
+	// Carried resevoirs have a new hit point, so their visibility is traced like in the shading pass
+	ShadowRayBatch shadowRays;
+
+	for (uint32_t y = yMin; y < yMax; y++)
+	{
+		for (uint32_t x = xMin; x < xMax; x++)
 		{
-			outputColor = sample.BRDF * sample.light.emmission / (sample.lightDistance * sample.lightDistance);
+			if (IsPixelShaded(x, y))
+				continue;
+
+			uint32_t bufferIndex = x + y * resolution.x;
+			const HitInfo& hitInfo = m_PrimaryHitBuffer[bufferIndex];
+			if (!hitInfo.hit)
+			{
+				m_HDRBuffer[bufferIndex] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+				continue;
+			}
+
+			// Shaded 3x3 neighbours on the same surface, weighted by normal and depth similarity
+			glm::vec4 radianceTotal = glm::vec4(0);
+			float weightTotal = 0.0f;
+			for (int32_t ny = std::max(static_cast<int32_t>(y) - 1, 0); ny <= std::min(static_cast<int32_t>(y) + 1, resolution.y - 1); ny++)
+			{
+				for (int32_t nx = std::max(static_cast<int32_t>(x) - 1, 0); nx <= std::min(static_cast<int32_t>(x) + 1, resolution.x - 1); nx++)
+				{
+					uint32_t neighbourIndex = nx + ny * resolution.x;
+					const HitInfo& neighbourHit = m_PrimaryHitBuffer[neighbourIndex];
+					if (!neighbourHit.hit || !IsPixelShaded(nx, ny))
+						continue;
+
+					float normalWeight = std::max(glm::dot(hitInfo.normal, neighbourHit.normal), 0.0f);
+					float depthWeight = std::max(1.0f - std::abs(hitInfo.distance - neighbourHit.distance) / (m_Settings.ShadingRateDepthThreshold * hitInfo.distance), 0.0f);
+					float weight = normalWeight * normalWeight * depthWeight + 0.0001f;
+
+					radianceTotal += weight * m_HDRBuffer[neighbourIndex];
+					weightTotal += weight;
+				}
+			}
+
+			// Pixels cut off from every shaded neighbour by the frame border shade their carried resevoir as is
+			if (weightTotal > 0.0f)
+			{
+				m_HDRBuffer[bufferIndex] = radianceTotal / weightTotal;
+			}
+			else
+			{
+				const Sample& sample = resevoirs[bufferIndex].GetSampleRef();
+				bool facesLight = sample.BRDF > 0.001f;
+				if (facesLight && !sample.visibilityKnown)
+					shadowRays.Add(sample.hitPosition, m_Scene.lights->GetLight(sample.lightIndex).position, sample.lightIndex, m_Settings.Eta, bufferIndex);
+				else
+					m_HDRBuffer[bufferIndex] = ShadeSample(resevoirs[bufferIndex], facesLight && sample.visible);
+			}
 		}
 	}
 
-	return glm::vec4(outputColor * resevoir.WeightSampleOut, 1.0f);
+	shadowRays.Trace(m_Scene.tlas);
+	m_ShadowRayCount += shadowRays.GetRayCount();
+
+	for (uint32_t i = 0; i < shadowRays.GetRayCount(); i++)
+	{
+		uint32_t bufferIndex = shadowRays.GetPayload(i);
+		m_HDRBuffer[bufferIndex] = ShadeSample(resevoirs[bufferIndex], !shadowRays.IsOccluded(i));
+	}
+}
+
+Renderer::ShadingRate Renderer::GetTileShadingRate(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, uint32_t width, uint32_t height) const
+{
+	// Size of a pixel at unit distance, converts object motion to pixels
+	float pixelSize = 2.0f * std::tan(glm::radians(m_Scene.camera.verticalFOV) * 0.5f) / static_cast<float>(height);
+
+	float luminanceTotal = 0.0f;
+	float luminanceSquaredTotal = 0.0f;
+	uint32_t hitCount = 0;
+	uint32_t pixelCount = 0;
+
+	for (uint32_t y = yMin; y < yMax; y++)
+	{
+		for (uint32_t x = xMin; x < xMax; x++)
+		{
+			uint32_t bufferIndex = x + y * width;
+			const HitInfo& hitInfo = m_PrimaryHitBuffer[bufferIndex];
+			pixelCount++;
+			if (!hitInfo.hit)
+				continue;
+
+			hitCount++;
+
+			// Moving objects, camera motion alone is followed by temporal reuse
+			float objectMotion = glm::length(m_MotionBuffer[bufferIndex].prevPosition - hitInfo.position) / (hitInfo.distance * pixelSize);
+			if (objectMotion > m_Settings.ShadingRateMotionThreshold)
+				return ShadingRate::Full;
+
+			// Depth and normal discontinuities with the right and lower neighbours
+			uint32_t neighbourIndices[2] = { std::min(x + 1, width - 1) + y * width, x + std::min(y + 1, height - 1) * width };
+			for (uint32_t neighbourIndex : neighbourIndices)
+			{
+				const HitInfo& neighbourHit = m_PrimaryHitBuffer[neighbourIndex];
+				bool edge = !neighbourHit.hit || glm::dot(hitInfo.normal, neighbourHit.normal) < 0.9f ||
+					std::abs(hitInfo.distance - neighbourHit.distance) > m_Settings.ShadingRateDepthThreshold * hitInfo.distance;
+				if (edge)
+					return ShadingRate::Full;
+			}
+
+			glm::vec4 radiance = m_HDRBuffer[bufferIndex];
+			float luminance = 0.2126f * radiance.r + 0.7152f * radiance.g + 0.0722f * radiance.b;
+			luminanceTotal += luminance;
+			luminanceSquaredTotal += luminance * luminance;
+		}
+	}
+
+	// Background only, nothing to shade
+	if (hitCount == 0)
+		return ShadingRate::Quarter;
+
+	// Silhouettes against the background
+	if (hitCount < pixelCount)
+		return ShadingRate::Full;
+
+	float mean = luminanceTotal / hitCount;
+	float variance = std::max(luminanceSquaredTotal / hitCount - mean * mean, 0.0f);
+	float relativeVariance = variance / std::max(mean * mean, 0.0001f);
+
+	if (relativeVariance < 0.25f * m_Settings.ShadingRateVarianceThreshold)
+		return ShadingRate::Quarter;
+	if (relativeVariance < m_Settings.ShadingRateVarianceThreshold)
+		return ShadingRate::Half;
+
+	return ShadingRate::Full;
+}
+
+void Renderer::UpdateShadingRates(uint32_t width, uint32_t height)
+{
+	uint32_t tilesPerRow = (width + ShadingRateTileSize - 1) / ShadingRateTileSize;
+	uint32_t tilesPerColumn = (height + ShadingRateTileSize - 1) / ShadingRateTileSize;
+	m_ShadingRates.resize(tilesPerRow * tilesPerColumn);
+
+	TaskBatch taskBatch(m_Settings.ThreadCount);
+	for (uint32_t tileY = 0; tileY < tilesPerColumn; tileY++)
+	{
+		taskBatch.EnqueueTask([=]() {
+			uint32_t yMin = tileY * ShadingRateTileSize;
+			uint32_t yMax = std::min(yMin + ShadingRateTileSize, height);
+			for (uint32_t tileX = 0; tileX < tilesPerRow; tileX++)
+			{
+				uint32_t xMin = tileX * ShadingRateTileSize;
+				uint32_t xMax = std::min(xMin + ShadingRateTileSize, width);
+				m_ShadingRates[tileX + tileY * tilesPerRow] = GetTileShadingRate(xMin, yMin, xMax, yMax, width, height);
+			}
+		});
+	}
+	taskBatch.ExecuteTasks();
+
+	m_ShadingRateResolution = glm::i32vec2(width, height);
 }
 
 // ================= Render Loop =================
@@ -246,45 +952,79 @@ void Renderer::RenderFrameBuffer()
 	while (!m_Terminate)
 	{
 		auto timeStart = std::chrono::system_clock::now();
+		m_ShadowRayCount = 0;
 
 		m_FrameBufferLock.lock();
 		FrameBufferRef framebuffer = m_FrameBuffers.GetRenderBuffer();
 		m_FrameBufferLock.unlock();
 
+		// Any change to what is rendered restarts progressive accumulation
+		bool viewChanged = !m_ValidHistory;
+
 		if (SettingsUpdated)
 		{
 			m_SettingsLock.lock();
 
 			if (m_Settings != m_NewSettings)
+			{
 				m_ValidHistory = false;
+				viewChanged = true;
+			}
+
+			// The accumulated average would mix frames rendered with both settings
+			if (!m_Settings.SameOutput(m_NewSettings))
+				viewChanged = true;
 
 			m_Settings = m_NewSettings;
 			SettingsUpdated = false;
 			m_SettingsLock.unlock();
 		}
 
-		if (SceneUpdated)
-		{
-			m_SceneLock.lock();
-			m_PrevCamera = m_Scene.camera;
-			m_Scene = m_NewScene;
-			m_SceneLock.unlock();
+		ApplySceneSnapshot(std::atomic_load(&m_LatestSnapshot), viewChanged);
 
-			m_Scene.camera.SetResolution(m_Settings.FrameWidth, m_Settings.FrameHeight);
-			m_Scene.camera.UpdateState();
+		if (!m_Settings.DynamicResolution)
+			m_ResolutionScale = 1.0f;
 
-			m_Scene.tlas.UpdateTransform();
-			m_Scene.tlas.Build();
-		}
+		// Rendering happens at the scaled resolution, only the output has the frame resolution
+		glm::i32vec2 renderResolution = GetScaledResolution();
+		uint32_t width = renderResolution.x;
+		uint32_t height = renderResolution.y;
+		uint32_t frameWidth = m_Settings.FrameWidth;
+		uint32_t frameHeight = m_Settings.FrameHeight;
 
-		uint32_t width = m_Settings.FrameWidth;
-		uint32_t height = m_Settings.FrameHeight;
+		// Motion vectors point into the previous frame's resolution
+		if (m_Scene.camera.GetResolution() != renderResolution)
+		{
+			m_Scene.camera.SetResolution(width, height);
+			m_Scene.camera.UpdateState();
+		}
+		if (m_PrevCamera.GetResolution() != m_PrevRenderResolution)
+		{
+			m_PrevCamera.SetResolution(m_PrevRenderResolution.x, m_PrevRenderResolution.y);
+			m_PrevCamera.UpdateState();
+		}
 
 		uint32_t bufferSize = width * height;
 		UpdateSampleBufferSize(bufferSize);
-		m_FrameBuffers.ResizeRenderBuffer(bufferSize);
+		UpdatePrimaryHitBufferSize(bufferSize);
+		UpdateMotionBufferSize(bufferSize);
+		UpdateStatisticsBufferSize(bufferSize);
+		UpdateHDRBufferSize(bufferSize);
+		UpdateAccumulationBufferSize(bufferSize);
+		m_FrameBuffers.ResizeRenderBuffer(frameWidth * frameHeight);
 		m_ResevoirBuffers.ResizeBuffers(bufferSize);
 
+		bool usesLights = m_Settings.Mode == RendererSettings::RenderMode::DI || m_Settings.Mode == RendererSettings::RenderMode::ReSTIR;
+		if (usesLights && m_Settings.LightSampling == RendererSettings::LightSamplingMode::ReGIR)
+		{
+			uint32_t gridSeed = m_Settings.RandomSeed ? static_cast<uint32_t>(timeStart.time_since_epoch().count()) : 0;
+			UpdateLightGrid(gridSeed);
+		}
+		else if (usesLights && m_Settings.LightSampling == RendererSettings::LightSamplingMode::Culled)
+		{
+			UpdateLightHashGrid();
+		}
+
 		if (m_Settings.Mode != RendererSettings::RenderMode::ReSTIR)
 		{
 			TaskBatch taskBatch(m_Settings.ThreadCount);
@@ -293,7 +1033,7 @@ void Renderer::RenderFrameBuffer()
 				for (uint32_t x = 0; x < width; x += m_Settings.TileSize)
 				{
 					uint32_t seed = x + y * width;
-					taskBatch.EnqueueTask([=]() {RenderKernelNonReSTIR(framebuffer, width, height, x, y, seed); });
+					taskBatch.EnqueueTask([=]() {RenderKernelNonReSTIR(width, height, x, y, seed); });
 				}
 			}
 			taskBatch.ExecuteTasks();
@@ -306,15 +1046,32 @@ void Renderer::RenderFrameBuffer()
 					int yOffset = y * width;
 					for (uint32_t x = 0; x < width; x += m_Settings.TileSize)
 					{
-						taskBatch.EnqueueTask([=]() { RenderKernelReSTIR(framebuffer, width, height, x, y, restirPass, x + yOffset); });
+						taskBatch.EnqueueTask([=]() { RenderKernelReSTIR(width, height, x, y, restirPass, x + yOffset); });
 					}
 				}
 				taskBatch.ExecuteTasks();
 			};
 
+			// Skipped pixels live off their temporal history, so the rates need one that lines up
+			m_VariableRateActive = m_Settings.VariableRateShading && m_Settings.EnableTemporalReuse && m_ValidHistory &&
+				m_ShadingRateResolution == glm::i32vec2(width, height);
+
 			TaskBatch taskBatch(m_Settings.ThreadCount);
+			auto primaryVisibilityStart = std::chrono::system_clock::now();
+			ReSTIRRender(ReSTIRPass::PrimaryVisibility, taskBatch);
+			m_LastPrimaryVisibilityTime = std::chrono::duration<float, std::ratio<1, 1000>>(std::chrono::system_clock::now() - primaryVisibilityStart).count();
+			m_RequestedCandidates = 0;
+			m_ShadedPixels = 0;
 			ReSTIRRender(ReSTIRPass::RIS, taskBatch);
 
+			// Scale next frame's requests so the total matches the average candidate count over the
+			// shaded pixels, skipped pixels must not hand their share to the shaded ones
+			if (m_Settings.AdaptiveCandidateCount && m_RequestedCandidates > 0)
+			{
+				float candidateBudget = static_cast<float>(m_Settings.CandidateCountReSTIR) * m_ShadedPixels;
+				m_CandidateBudgetScale = glm::clamp(candidateBudget / m_RequestedCandidates, 0.05f, 20.0f);
+			}
+
 			if (m_Settings.EnableVisibilityPass)
 				ReSTIRRender(ReSTIRPass::Visibility, taskBatch);
 
@@ -323,15 +1080,45 @@ void Renderer::RenderFrameBuffer()
 
 			if (m_Settings.EnableSpatialReuse)
 			{
+				UpdateNeighbourOffsets(m_Settings.RandomSeed ? static_cast<uint32_t>(timeStart.time_since_epoch().count()) : 0);
 				ReSTIRRender(ReSTIRPass::Spatial, taskBatch);
 				m_ResevoirBuffers.SwapSpatialBuffers();
 			}
 
 			ReSTIRRender(ReSTIRPass::Shading, taskBatch);
+
+			if (m_VariableRateActive)
+				ReSTIRRender(ReSTIRPass::Reconstruction, taskBatch);
+
+			if (m_Settings.VariableRateShading)
+				UpdateShadingRates(width, height);
+
+			if (m_Settings.Denoise)
+				DenoiseHDRBuffer(width, height);
+		}
+
+		if (m_Settings.ProgressiveAccumulation)
+			AccumulateHDRBuffer(width, height, viewChanged || m_AccumulatedFrames == 0);
+		else
+			m_AccumulatedFrames = 0;
+
+		if (width == frameWidth && height == frameHeight)
+		{
+			TonemapFrameBuffer(framebuffer, m_HDRBuffer.data(), width, height);
+		}
+		else
+		{
+			UpscaleHDRBuffer(width, height, frameWidth, frameHeight);
+			TonemapFrameBuffer(framebuffer, m_UpscaledHDRBuffer.data(), frameWidth, frameHeight);
 		}
 
 		auto timeEnd = std::chrono::system_clock::now();
 		m_LastFrameTime = std::chrono::duration<float, std::ratio<1, 1000>>(timeEnd - timeStart).count();
+		m_LastShadowRaysPerPixel = static_cast<float>(m_ShadowRayCount) / bufferSize;
+
+		m_PrevRenderResolution = renderResolution;
+		if (m_Settings.DynamicResolution)
+			UpdateResolutionScale(m_LastFrameTime);
 
 		m_FrameBufferLock.lock();
 		m_FrameBuffers.SwapBuffers();
@@ -340,10 +1127,30 @@ void Renderer::RenderFrameBuffer()
 
 		m_ValidHistory = true && m_ValidHistoryNextFrame;
 		m_ValidHistoryNextFrame = true;
+		m_FrameIndex++;
 	}
 }
 
-void Renderer::RenderKernelNonReSTIR(FrameBufferRef frameBuffer, uint32_t width, uint32_t height, uint32_t xMin, uint32_t yMin, uint32_t seed)
+void Renderer::TonemapFrameBuffer(FrameBufferRef frameBuffer, const glm::vec4* hdrPixels, uint32_t width, uint32_t height)
+{
+	// Debug render modes are displayed as is
+	PostProcessing::DisplaySettings displaySettings;
+	if (m_Settings.Mode == RendererSettings::RenderMode::DI || m_Settings.Mode == RendererSettings::RenderMode::ReSTIR)
+		displaySettings = PostProcessing::DisplaySettings(m_Settings.Exposure, m_Settings.Tonemapper, m_Settings.SRGBOutput);
+
+	uint8_t* displayPixels = frameBuffer->data();
+
+	TaskBatch taskBatch(m_Settings.ThreadCount);
+	for (uint32_t y = 0; y < height; y += m_Settings.TileSize)
+	{
+		uint32_t rowOffset = y * width;
+		uint32_t pixelCount = std::min(static_cast<uint32_t>(m_Settings.TileSize), height - y) * width;
+		taskBatch.EnqueueTask([=]() { PostProcessing::TonemapKernel(hdrPixels + rowOffset, displayPixels + rowOffset * 4, pixelCount, displaySettings); });
+	}
+	taskBatch.ExecuteTasks();
+}
+
+void Renderer::RenderKernelNonReSTIR(uint32_t width, uint32_t height, uint32_t xMin, uint32_t yMin, uint32_t seed)
 {
 	uint32_t xMax = std::min(xMin + m_Settings.TileSize, width);
 	uint32_t yMax = std::min(yMin + m_Settings.TileSize, height);
@@ -355,7 +1162,6 @@ void Renderer::RenderKernelNonReSTIR(FrameBufferRef frameBuffer, uint32_t width,
 		seed += milliseconds;
 	}
 
-	glm::vec4 colorAccumulator;
 	auto renderKernel = [&](std::function<glm::vec4(Ray&, const TLAS&, const RendererSettings&, uint32_t&)> renderFunction)
 	{
 		for (uint32_t y = yMin; y < yMax; y++)
@@ -363,7 +1169,7 @@ void Renderer::RenderKernelNonReSTIR(FrameBufferRef frameBuffer, uint32_t width,
 			for (uint32_t x = xMin; x < xMax; x++)
 			{
 				Ray ray = m_Scene.camera.GetRay(x, y);
-				Utils::FillFrameBufferPixel(x, y, renderFunction(ray, m_Scene.tlas, m_Settings, seed), width, frameBuffer);
+				m_HDRBuffer[x + y * width] = renderFunction(ray, m_Scene.tlas, m_Settings, seed);
 			}
 		}
 	};
@@ -382,9 +1188,7 @@ void Renderer::RenderKernelNonReSTIR(FrameBufferRef frameBuffer, uint32_t width,
 			for (uint32_t x = xMin; x < xMax; x++)
 			{
 				Ray ray = m_Scene.camera.GetRay(x, y);
-				colorAccumulator = RenderDI(ray, seed);
-
-				Utils::FillFrameBufferPixel(x, y, colorAccumulator, width, frameBuffer);
+				m_HDRBuffer[x + y * width] = RenderDI(ray, seed);
 			}
 		}
 		break;
@@ -392,7 +1196,7 @@ void Renderer::RenderKernelNonReSTIR(FrameBufferRef frameBuffer, uint32_t width,
 
 }
 
-void Renderer::RenderKernelReSTIR(FrameBufferRef frameBuffer, uint32_t width, uint32_t height, uint32_t xMin, uint32_t yMin, ReSTIRPass restirPass, uint32_t seed)
+void Renderer::RenderKernelReSTIR(uint32_t width, uint32_t height, uint32_t xMin, uint32_t yMin, ReSTIRPass restirPass, uint32_t seed)
 {
 	uint32_t xMax = std::min(xMin + m_Settings.TileSize, width);
 	uint32_t yMax = std::min(yMin + m_Settings.TileSize, height);
@@ -404,55 +1208,182 @@ void Renderer::RenderKernelReSTIR(FrameBufferRef frameBuffer, uint32_t width, ui
 
 	switch (restirPass)
 	{
-	case ReSTIRPass::RIS:
-		for (uint32_t y = yMin; y < yMax; y++)
+	case ReSTIRPass::PrimaryVisibility:
+		for (uint32_t y = yMin; y < yMax; y += TLAS::PacketWidth)
 		{
-			uint32_t yOffset = y * width;
-			for (uint32_t x = xMin; x < xMax; x++)
+			for (uint32_t x = xMin; x < xMax; x += TLAS::PacketWidth)
 			{
-				GenerateSample(glm::i32vec2(x, y), x + yOffset, seed);
+				TracePrimaryBlock(x, y, std::min(x + TLAS::PacketWidth, xMax), std::min(y + TLAS::PacketWidth, yMax), width);
 			}
 		}
 		break;
-	case ReSTIRPass::Visibility:
+	case ReSTIRPass::RIS:
+	{
+		uint32_t requestedCandidates = 0;
+		uint32_t shadedPixels = 0;
 		for (uint32_t y = yMin; y < yMax; y++)
 		{
 			uint32_t yOffset = y * width;
 			for (uint32_t x = xMin; x < xMax; x++)
 			{
-				VisibilityPass(x + yOffset);
+				if (m_VariableRateActive && !IsPixelShaded(x, y))
+				{
+					SkipSample(x + yOffset);
+					continue;
+				}
+
+				shadedPixels++;
+				uint32_t candidateCount = m_Settings.CandidateCountReSTIR;
+				if (m_Settings.AdaptiveCandidateCount)
+				{
+					float requestedCount = GetRequestedCandidateCount(glm::i32vec2(x, y), x + yOffset);
+					requestedCandidates += static_cast<uint32_t>(requestedCount + 0.5f);
+
+					float scaledCount = std::round(requestedCount * m_CandidateBudgetScale);
+					candidateCount = static_cast<uint32_t>(glm::clamp(scaledCount, static_cast<float>(m_Settings.MinCandidateCountReSTIR), static_cast<float>(m_Settings.MaxCandidateCountReSTIR)));
+				}
+
+				GenerateSample(glm::i32vec2(x, y), x + yOffset, std::max(candidateCount, 1u), seed);
 			}
 		}
+		m_RequestedCandidates += requestedCandidates;
+		m_ShadedPixels += shadedPixels;
+		break;
+	}
+	case ReSTIRPass::Visibility:
+		VisibilityPass(xMin, yMin, xMax, yMax, width);
 		break;
 	case ReSTIRPass::Temporal:
-		for (uint32_t y = yMin; y < yMax; y++)
-		{
-			uint32_t yOffset = y * width;
-			for (uint32_t x = xMin; x < xMax; x++)
-			{
-				TemporalReuse(glm::i32vec2(x, y), glm::i32vec2(width, height), x + yOffset, seed);
-			}
-		}
+		TemporalReuse(xMin, yMin, xMax, yMax, glm::i32vec2(width, height), seed);
 		break;
 	case ReSTIRPass::Spatial:
-		for (uint32_t y = yMin; y < yMax; y++)
-		{
-			uint32_t yOffset = y * width;
-			for (uint32_t x = xMin; x < xMax; x++)
+		SpatialReuse(xMin, yMin, xMax, yMax, glm::i32vec2(width, height), seed);
+		break;
+	case ReSTIRPass::Shading:
+		ShadingPass(xMin, yMin, xMax, yMax, width);
+		break;
+	case ReSTIRPass::Reconstruction:
+		ReconstructionPass(xMin, yMin, xMax, yMax, glm::i32vec2(width, height));
+		break;
+	}
+}
+
+// ================= Dynamic Resolution =================
+
+glm::i32vec2 Renderer::GetScaledResolution() const
+{
+	uint32_t width = static_cast<uint32_t>(m_Settings.FrameWidth * m_ResolutionScale + 0.5f);
+	uint32_t height = static_cast<uint32_t>(m_Settings.FrameHeight * m_ResolutionScale + 0.5f);
+	return glm::i32vec2(std::max(width, 1u), std::max(height, 1u));
+}
+
+void Renderer::UpdateResolutionScale(float frameTime)
+{
+	// Frame time scales roughly with the pixel count, the square of the resolution scale
+	float timeRatio = m_Settings.TargetFrameTime / std::max(frameTime, 0.001f);
+
+	// Dead zone so small timing noise doesn't resize every frame
+	if (std::abs(timeRatio - 1.0f) < 0.05f)
+		return;
+
+	float resolutionScale = m_ResolutionScale;
+	float targetScale = resolutionScale * std::sqrt(timeRatio);
+	float minScale = glm::clamp(m_Settings.MinResolutionScale, 0.1f, 1.0f);
+	m_ResolutionScale = glm::clamp(glm::mix(resolutionScale, targetScale, 0.5f), minScale, 1.0f);
+}
+
+void Renderer::UpscaleHDRBuffer(uint32_t width, uint32_t height, uint32_t frameWidth, uint32_t frameHeight)
+{
+	UpdateUpscaledHDRBufferSize(frameWidth * frameHeight);
+	glm::vec2 scale = glm::vec2(width, height) / glm::vec2(frameWidth, frameHeight);
+
+	TaskBatch taskBatch(m_Settings.ThreadCount);
+	for (uint32_t yMin = 0; yMin < frameHeight; yMin += m_Settings.TileSize)
+	{
+		uint32_t yMax = std::min(yMin + m_Settings.TileSize, frameHeight);
+		taskBatch.EnqueueTask([=]() {
+			for (uint32_t y = yMin; y < yMax; y++)
 			{
-				SpatialReuse(glm::i32vec2(x, y), glm::i32vec2(width, height), x + yOffset, seed);
+				// Bilinear filter between the centers of the rendered pixels
+				float sourceY = glm::clamp((y + 0.5f) * scale.y - 0.5f, 0.0f, static_cast<float>(height - 1));
+				uint32_t y0 = static_cast<uint32_t>(sourceY);
+				uint32_t y1 = std::min(y0 + 1, height - 1);
+				float fy = sourceY - y0;
+
+				for (uint32_t x = 0; x < frameWidth; x++)
+				{
+					float sourceX = glm::clamp((x + 0.5f) * scale.x - 0.5f, 0.0f, static_cast<float>(width - 1));
+					uint32_t x0 = static_cast<uint32_t>(sourceX);
+					uint32_t x1 = std::min(x0 + 1, width - 1);
+					float fx = sourceX - x0;
+
+					glm::vec4 top = glm::mix(m_HDRBuffer[x0 + y0 * width], m_HDRBuffer[x1 + y0 * width], fx);
+					glm::vec4 bottom = glm::mix(m_HDRBuffer[x0 + y1 * width], m_HDRBuffer[x1 + y1 * width], fx);
+					m_UpscaledHDRBuffer[x + y * frameWidth] = glm::mix(top, bottom, fy);
+				}
 			}
+		});
+	}
+	taskBatch.ExecuteTasks();
+}
+
+// ================= Denoising & Accumulation =================
+
+void Renderer::DenoiseHDRBuffer(uint32_t width, uint32_t height)
+{
+	Denoiser::FilterSettings filterSettings(m_Settings.DenoiseHistoryAlpha, m_Settings.DenoiseColorPhi, m_Settings.DenoiseDepthPhi);
+	m_Denoiser.BeginFrame(width, height, m_FrameIndex, filterSettings, m_ValidHistory);
+
+	TaskBatch taskBatch(m_Settings.ThreadCount);
+	auto denoiseRows = [&](std::function<void(uint32_t, uint32_t)> rowKernel) {
+		for (uint32_t y = 0; y < height; y += m_Settings.TileSize)
+		{
+			uint32_t yMax = std::min(y + m_Settings.TileSize, height);
+			taskBatch.EnqueueTask([=]() { rowKernel(y, yMax); });
 		}
-		break;
-	case ReSTIRPass::Shading:
+		taskBatch.ExecuteTasks();
+	};
+
+	denoiseRows([=](uint32_t yMin, uint32_t yMax) {
 		for (uint32_t y = yMin; y < yMax; y++)
 		{
-			uint32_t yOffset = y * width;
-			for (uint32_t x = xMin; x < xMax; x++)
+			for (uint32_t x = 0; x < width; x++)
 			{
-				Utils::FillFrameBufferPixel(x, y, RenderSample(x + yOffset, seed), width, frameBuffer);
+				uint32_t bufferIndex = x + y * width;
+				const PixelMotion& pixelMotion = m_MotionBuffer[bufferIndex];
+				m_Denoiser.AccumulatePixel(glm::i32vec2(x, y), m_HDRBuffer[bufferIndex], m_PrimaryHitBuffer[bufferIndex], pixelMotion.motionVector, pixelMotion.prevPosition, pixelMotion.prevNormal);
 			}
 		}
-		break;
+	});
+	denoiseRows([=](uint32_t yMin, uint32_t yMax) { m_Denoiser.EstimateVariance(yMin, yMax); });
+
+	uint32_t iterationCount = m_Settings.DenoiseIterations;
+	for (uint32_t iteration = 0; iteration < iterationCount; iteration++)
+	{
+		denoiseRows([=](uint32_t yMin, uint32_t yMax) { m_Denoiser.FilterRows(iteration, yMin, yMax); });
+	}
+
+	denoiseRows([=](uint32_t yMin, uint32_t yMax) { m_Denoiser.WriteOutput(iterationCount, m_HDRBuffer.data(), yMin, yMax); });
+	m_Denoiser.EndFrame();
+}
+
+void Renderer::AccumulateHDRBuffer(uint32_t width, uint32_t height, bool restart)
+{
+	m_AccumulatedFrames = restart ? 1 : m_AccumulatedFrames + 1;
+	float invFrameCount = 1.0f / static_cast<float>(m_AccumulatedFrames);
+
+	TaskBatch taskBatch(m_Settings.ThreadCount);
+	for (uint32_t y = 0; y < height; y += m_Settings.TileSize)
+	{
+		uint32_t firstPixel = y * width;
+		uint32_t lastPixel = std::min(y + m_Settings.TileSize, height) * width;
+		taskBatch.EnqueueTask([=]() {
+			for (uint32_t i = firstPixel; i < lastPixel; i++)
+			{
+				m_AccumulationBuffer[i] = restart ? m_HDRBuffer[i] : m_AccumulationBuffer[i] + m_HDRBuffer[i];
+				m_HDRBuffer[i] = m_AccumulationBuffer[i] * invFrameCount;
+			}
+		});
 	}
-}
\ No newline at end of file
+	taskBatch.ExecuteTasks();
+}
@@ -2,6 +2,7 @@
 
 #include <thread>
 #include <mutex>
+#include <atomic>
 
 #include "Glad/include/glad/glad.h"
 
@@ -11,9 +12,16 @@
 #include "Camera.h"
 #include "Ray.h"
 #include "PointLight.h"
+#include "LightBuffer.h"
 
 #include "ReSTIR.h"
 #include "RendererSettings.h"
+#include "LightSampler.h"
+#include "LightBVH.h"
+#include "LightGrid.h"
+#include "LightHashGrid.h"
+#include "Denoiser.h"
+#include "Sampler.h"
 
 #include "Utils.h"
 
@@ -82,9 +90,10 @@ public:
 	std::vector<Resevoir>& GetPrevBuffer() { return m_ResevoirBuffers[m_PrevBuffer]; }
 	std::vector<Resevoir>& GetSpatialReuseBuffer() { return m_ResevoirBuffers[m_SpatialReuseBuffer]; }
 
+	// Only grows, the previous frame's resevoirs stay addressable when the render resolution shrinks
 	void ResizeBuffers(uint32_t bufferSize) 
 	{
-		if (m_ResevoirBuffers[0].size() != bufferSize || m_ResevoirBuffers[1].size() != bufferSize || m_ResevoirBuffers[2].size() != bufferSize)
+		if (m_ResevoirBuffers[0].size() < bufferSize || m_ResevoirBuffers[1].size() < bufferSize || m_ResevoirBuffers[2].size() < bufferSize)
 		{
 			m_ResevoirBuffers[0].resize(bufferSize);
 			m_ResevoirBuffers[1].resize(bufferSize);
@@ -103,27 +112,92 @@ class Renderer
 public:
 	enum class ReSTIRPass
 	{
+		PrimaryVisibility,
 		RIS,
 		Visibility,
 		Temporal,
 		Spatial,
-		Shading
+		Shading,
+		Reconstruction
 	};
 
+	// Immutable state of the scene at one version, published by the UI thread every frame.
+	// Parts that didn't change are shared with the previous version, so publishing copies no geometry.
+	struct SceneSnapshot
+	{
+		uint64_t version;
+		Camera camera;
+		std::shared_ptr<const std::vector<std::shared_ptr<BLAS>>> objects; // Indexed by BLAS handle, only ever grows
+		std::shared_ptr<const std::vector<TLAS::Instance>> instances; // Only ever grows
+		LightBufferRef lights;
+
+		SceneSnapshot() :
+			version{ 0 }
+		{}
+	};
+
+	using SceneSnapshotRef = std::shared_ptr<const SceneSnapshot>;
+private:
+	// The render thread's own scene, brought up to date with the latest snapshot every frame
 	struct Scene
 	{
 		Camera camera;
 		TLAS tlas;
-		std::vector<PointLight> pointLights;
+		LightBufferRef lights;
+
+		Scene() :
+			lights{ std::make_shared<const LightBuffer>() }
+		{}
+	};
 
-		Scene() = default;
+	// Motion of the primary hit, computed once per pixel for temporal reprojection
+	struct PixelMotion
+	{
+		glm::vec2 motionVector; // Offset from this pixel's center to the hit in the previous frame, in previous frame pixels
+		glm::vec3 prevPosition;
+		glm::vec3 prevNormal;
 
-		Scene(const Camera& camera, const TLAS& tlas, const std::vector<PointLight>& pointLights) :
-			camera{ camera }, tlas{ tlas }, pointLights{ pointLights }
+		PixelMotion() :
+			motionVector{ glm::vec2(0) }, prevPosition{ glm::vec3(0) }, prevNormal{ glm::vec3(0) }
 		{}
 	};
-private:
+
+	// Running mean of a pixel's resevoir weight, drives the adaptive candidate count
+	struct PixelStatistics
+	{
+		float meanWeight;
+		float meanWeightSquared;
+
+		PixelStatistics() :
+			meanWeight{ 0.0f }, meanWeightSquared{ 0.0f }
+		{}
+	};
+
+	enum class ShadingRate : uint8_t
+	{
+		Full,
+		Half, // Checkerboard
+		Quarter // One pixel of every 2x2 block
+	};
+
+	// Resevoir that passed the geometric reuse tests and waits for its shadow ray
+	struct ReuseCandidate
+	{
+		uint32_t bufferIndex;
+		uint32_t candidateIndex; // Buffer index of the temporal or spatial neighbour
+	};
+
 	std::vector<Sample> m_SampleBuffer;
+	std::vector<HitInfo> m_PrimaryHitBuffer; // Camera ray hit per pixel, traced once per frame
+	std::vector<PixelMotion> m_MotionBuffer; // Written together with the primary hits
+	std::vector<PixelStatistics> m_StatisticsBuffer;
+	std::vector<glm::vec4> m_HDRBuffer; // Linear radiance, tonemapped into the frame buffers at the end of a frame
+	std::vector<glm::vec4> m_AccumulationBuffer; // Sum of the HDR output of all frames since the view last changed
+	std::atomic<uint32_t> m_AccumulatedFrames; // Read by the UI thread
+	std::vector<glm::vec4> m_UpscaledHDRBuffer; // Frame sized HDR output when rendering below the frame resolution
+
+	std::atomic<float> m_ResolutionScale; // Adjusted every frame when the resolution is dynamic, read by the UI thread
+	glm::i32vec2 m_PrevRenderResolution; // Resolution the previous frame's history buffers are laid out in
 	DoubleFrameBuffer m_FrameBuffers;
 	TripleResevoirBuffer m_ResevoirBuffers;
 	bool m_ValidHistory;
@@ -132,56 +206,133 @@ private:
 	RendererSettings m_Settings;
 	Scene m_Scene;
 	Camera m_PrevCamera;
+	AliasTable m_LightAliasTable; // Light power distribution, rebuilt when the lights change
+	LightBVH m_LightBVH; // Refitted or rebuilt when the lights change
+	LightGrid m_LightGrid; // Refilled every frame when used
+	LightHashGrid m_LightHashGrid; // Rebuilt when the lights or culling settings change
+	Denoiser m_Denoiser;
+
+	// Blue noise sampling, every pass reads its own dimensions of the texture
+	BlueNoiseTexture m_BlueNoise;
+	static constexpr uint32_t CandidateSamplerDimension = 0; // One per RIS candidate
+	static constexpr uint32_t TemporalSamplerDimension = 64;
+	static constexpr uint32_t SpatialSamplerDimension = 65;
+
+	static constexpr uint32_t NeighbourOffsetCount = 64; // Power of two
+	std::vector<glm::i32vec2> m_NeighbourOffsets; // Spatial reuse offsets, rotated every frame
+
+	// Adaptive candidate count, scales the requested counts towards the candidate budget
+	std::atomic<uint32_t> m_RequestedCandidates;
+	std::atomic<uint32_t> m_ShadedPixels; // Ran RIS this frame, variable rate shading skips the others
+	float m_CandidateBudgetScale;
+
+	// Variable rate shading, the rates are derived from a frame's output and used by the next frame
+	static constexpr uint32_t ShadingRateTileSize = 8;
+	std::vector<ShadingRate> m_ShadingRates;
+	glm::i32vec2 m_ShadingRateResolution; // Render resolution the rates were computed at
+	bool m_VariableRateActive; // Needs valid temporal history to carry skipped pixels
 
 	RendererSettings m_NewSettings;
-	Scene m_NewScene;
+
+	// Swapped with std::atomic_load and std::atomic_store, neither thread waits for the other
+	SceneSnapshotRef m_LatestSnapshot;
+	SceneSnapshotRef m_PublishedSnapshot; // UI thread
+	SceneSnapshotRef m_AppliedSnapshot; // Render thread, the version m_Scene is built from
 
 	std::thread m_RenderThread; 
 	std::atomic<bool> m_Terminate;
 
 	std::mutex m_FrameBufferLock;
 	std::mutex m_SettingsLock;
-	std::mutex m_SceneLock;
 
 	bool SettingsUpdated;
-	bool SceneUpdated;
 
-	float m_LastFrameTime;
+	// Frame statistics, written by the render thread and read by the UI thread
+	std::atomic<float> m_LastFrameTime;
+	std::atomic<float> m_LastPrimaryVisibilityTime; // To compare packet and single ray traversal
+	std::atomic<uint32_t> m_ShadowRayCount; // Traced by the ReSTIR passes this frame
+	std::atomic<float> m_LastShadowRaysPerPixel;
+	uint32_t m_FrameIndex;
 
 private:
 	void RenderFrameBuffer();
-	void Renderer::RenderKernelNonReSTIR(FrameBufferRef frameBuffer, uint32_t width, uint32_t height, uint32_t xMin, uint32_t yMin, uint32_t seed);
-	void Renderer::RenderKernelReSTIR(FrameBufferRef frameBuffer, uint32_t width, uint32_t height, uint32_t xMin, uint32_t yMin, ReSTIRPass restirPass, uint32_t seed);
+	void Renderer::RenderKernelNonReSTIR(uint32_t width, uint32_t height, uint32_t xMin, uint32_t yMin, uint32_t seed);
+	void Renderer::RenderKernelReSTIR(uint32_t width, uint32_t height, uint32_t xMin, uint32_t yMin, ReSTIRPass restirPass, uint32_t seed);
+	void Renderer::TonemapFrameBuffer(FrameBufferRef frameBuffer, const glm::vec4* hdrPixels, uint32_t width, uint32_t height);
+	void UpscaleHDRBuffer(uint32_t width, uint32_t height, uint32_t frameWidth, uint32_t frameHeight);
+	void UpdateResolutionScale(float frameTime);
+	glm::i32vec2 GetScaledResolution() const;
+	void DenoiseHDRBuffer(uint32_t width, uint32_t height);
+	void AccumulateHDRBuffer(uint32_t width, uint32_t height, bool restart);
 	
+	// Called every frame, also advances the previous camera and instance motion when the snapshot didn't change
+	void ApplySceneSnapshot(const SceneSnapshotRef& snapshot, bool& viewChanged);
+
+	void UpdateLightSampler();
+	void UpdateLightGrid(uint32_t seed);
+	void UpdateLightHashGrid();
+	// Randoms in [0, 1) select the light, only the alias table uses both
+	inline uint32_t SampleLight(const HitInfo& hitInfo, const glm::vec2& random, float& pdf) const;
+	PixelSampler GetPixelSampler(const glm::i32vec2 pixel, uint32_t firstDimension, uint32_t& seed) const
+	{
+		bool blueNoise = m_Settings.Sampler == RendererSettings::SamplerType::BlueNoise;
+		return PixelSampler(blueNoise ? &m_BlueNoise : nullptr, pixel, m_FrameIndex, firstDimension, seed);
+	}
+
 	glm::vec4 RenderDI(Ray& ray, uint32_t& seed);
 
-	// ResTIR passes
-	inline void GenerateSample(const glm::i32vec2 pixel, uint32_t bufferIndex, uint32_t& seed);
-	inline void VisibilityPass(uint32_t bufferIndex);
-	inline void TemporalReuse(const glm::i32vec2& pixel, const glm::i32vec2 resolution, uint32_t bufferIndex, uint32_t& seed);
-	inline void CombineNeighbourPixel(Resevoir& resevoir, const glm::i32vec2 pixel, const glm::i32vec2& resolution, uint32_t& seed);
-	inline void SpatialReuse(const glm::i32vec2& pixel, const glm::i32vec2& resolution, uint32_t bufferIndex, uint32_t& seed);
-	inline glm::vec4 RenderSample(uint32_t bufferIndex, uint32_t& seed);
+	// ResTIR passes, the shadow rays of a tile are collected and traced as one batch
+	inline void TracePrimaryRay(const glm::i32vec2 pixel, uint32_t bufferIndex);
+	inline void TracePrimaryBlock(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, uint32_t width);
+	inline void WritePixelMotion(const glm::i32vec2 pixel, uint32_t bufferIndex);
+	inline float GetRequestedCandidateCount(const glm::i32vec2 pixel, uint32_t bufferIndex);
+	inline void GenerateSample(const glm::i32vec2 pixel, uint32_t bufferIndex, uint32_t candidateCount, uint32_t& seed);
+	inline void UpdatePixelStatistics(uint32_t bufferIndex);
+	inline void VisibilityPass(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, uint32_t width);
+	inline bool FindTemporalCandidate(const glm::i32vec2& resolution, uint32_t bufferIndex, uint32_t& seed, uint32_t& prevIndex);
+	inline void CombineTemporalCandidate(uint32_t bufferIndex, uint32_t prevIndex, bool visibilityTraced, uint32_t& seed);
+	inline void TemporalReuse(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, const glm::i32vec2& resolution, uint32_t& seed);
+	void UpdateNeighbourOffsets(uint32_t seed);
+	inline bool FindNeighbourCandidate(const Sample& pixelSample, const glm::i32vec2 pixel, const glm::i32vec2& resolution, uint32_t offsetIndex, uint32_t& neighbourIndex);
+	inline void CombineNeighbourPixel(Resevoir& pixelResevoir, uint32_t neighbourIndex, bool visibilityTraced, uint32_t& seed);
+	inline void SpatialReuse(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, const glm::i32vec2& resolution, uint32_t& seed);
+	inline void ShadingPass(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, uint32_t width);
+
+	// Variable rate shading
+	inline bool IsPixelShaded(uint32_t x, uint32_t y) const;
+	inline void SkipSample(uint32_t bufferIndex);
+	inline void CarryTemporalResevoir(uint32_t bufferIndex, uint32_t prevIndex);
+	inline void ReconstructionPass(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, const glm::i32vec2& resolution);
+	void UpdateShadingRates(uint32_t width, uint32_t height);
+	ShadingRate GetTileShadingRate(uint32_t xMin, uint32_t yMin, uint32_t xMax, uint32_t yMax, uint32_t width, uint32_t height) const;
+	inline glm::vec4 ShadeSample(const Resevoir& resevoir, bool visible) const;
 public:
 	Renderer() :
-		m_LastFrameTime{ 0.0f }, m_SampleBuffer{ std::vector<Sample>() }
+		m_LastFrameTime{ 0.0f }, m_LastPrimaryVisibilityTime{ 0.0f }, m_ShadowRayCount{ 0 }, m_LastShadowRaysPerPixel{ 0.0f }, m_FrameIndex{ 0 }, m_AccumulatedFrames{ 0 }, m_ResolutionScale{ 1.0f }, m_PrevRenderResolution{ glm::i32vec2(0) }, m_ShadingRateResolution{ glm::i32vec2(0) }, m_VariableRateActive{ false }, m_RequestedCandidates{ 0 }, m_ShadedPixels{ 0 }, m_CandidateBudgetScale{ 1.0f }, m_SampleBuffer{ std::vector<Sample>() }, m_PrimaryHitBuffer{ std::vector<HitInfo>() }, m_MotionBuffer{ std::vector<PixelMotion>() }, m_HDRBuffer{ std::vector<glm::vec4>() }
 	{
 		m_FrameBuffers = DoubleFrameBuffer();
 		m_ResevoirBuffers = TripleResevoirBuffer();
 
 		SettingsUpdated = false;
-		SceneUpdated = false;
 		m_ValidHistory = false;
 		m_ValidHistoryNextFrame = true;
 
 		m_Terminate = false;
 	}
 
-	void Init(const RendererSettings& settings, const Scene& scene)
+	// Must be called before Init, blue noise sampling falls back to white noise without a texture
+	bool LoadBlueNoise(const std::string& filepath) { return m_BlueNoise.Load(filepath); }
+
+	void Init(const RendererSettings& settings, const Camera& camera, const TLAS& tlas, const LightBufferRef& lights)
 	{
 		m_Settings = settings;
-		m_Scene = scene; // Doesn't need to lock due to render thread not being spawned yet.
-		m_PrevCamera = scene.camera;
+		m_PrevRenderResolution = glm::i32vec2(m_Settings.FrameWidth, m_Settings.FrameHeight);
+
+		// Doesn't need to wait for the render thread, it isn't spawned yet
+		bool viewChanged = false;
+		SubmitScene(camera, tlas, lights);
+		ApplySceneSnapshot(m_LatestSnapshot, viewChanged);
+		m_PrevCamera = m_Scene.camera;
 		m_FrameBuffers.ResizeRenderBuffer(m_Settings.FrameWidth * m_Settings.FrameHeight);
 		m_FrameBuffers.SwapBuffers();
 		m_FrameBuffers.ResizeRenderBuffer(m_Settings.FrameWidth * m_Settings.FrameHeight);
@@ -200,13 +351,8 @@ public:
 		m_SettingsLock.unlock();
 	}
 
-	void SubmitScene(const Scene& newScene) 
-	{
-		m_SceneLock.lock();
-		m_NewScene = newScene;
-		SceneUpdated = true;
-		m_SceneLock.unlock();
-	}
+	// Publishes a new scene version, the renderer takes over BLASes and transforms but never the TLAS itself
+	void SubmitScene(const Camera& camera, const TLAS& tlas, const LightBufferRef& lights);
 
 	void UpdateSampleBufferSize(uint32_t bufferSize)
 	{
@@ -216,6 +362,55 @@ public:
 		}
 	}
 
+	void UpdatePrimaryHitBufferSize(uint32_t bufferSize)
+	{
+		if (m_PrimaryHitBuffer.size() != bufferSize)
+		{
+			m_PrimaryHitBuffer.resize(bufferSize);
+		}
+	}
+
+	void UpdateMotionBufferSize(uint32_t bufferSize)
+	{
+		if (m_MotionBuffer.size() != bufferSize)
+		{
+			m_MotionBuffer.resize(bufferSize);
+		}
+	}
+
+	void UpdateStatisticsBufferSize(uint32_t bufferSize)
+	{
+		if (m_StatisticsBuffer.size() != bufferSize)
+		{
+			m_StatisticsBuffer.resize(bufferSize);
+		}
+	}
+
+	void UpdateHDRBufferSize(uint32_t bufferSize)
+	{
+		if (m_HDRBuffer.size() != bufferSize)
+		{
+			m_HDRBuffer.resize(bufferSize);
+		}
+	}
+
+	void UpdateUpscaledHDRBufferSize(uint32_t bufferSize)
+	{
+		if (m_UpscaledHDRBuffer.size() != bufferSize)
+		{
+			m_UpscaledHDRBuffer.resize(bufferSize);
+		}
+	}
+
+	void UpdateAccumulationBufferSize(uint32_t bufferSize)
+	{
+		if (m_AccumulationBuffer.size() != bufferSize)
+		{
+			m_AccumulationBuffer.resize(bufferSize);
+			m_AccumulatedFrames = 0;
+		}
+	}
+
 	void UpdateResevoirBufferSize(uint32_t bufferSize)
 	{
 		if (m_ResevoirBuffers.GetCurrentBuffer().size() != bufferSize || m_ResevoirBuffers.GetPrevBuffer().size() != bufferSize)
@@ -226,6 +421,10 @@ public:
 	}
 
 	float GetLastFrameTime() { return m_LastFrameTime; }
+	float GetLastPrimaryVisibilityTime() { return m_LastPrimaryVisibilityTime; }
+	float GetLastShadowRaysPerPixel() { return m_LastShadowRaysPerPixel; }
+	uint32_t GetAccumulatedFrameCount() { return m_AccumulatedFrames; }
+	float GetResolutionScale() { return m_ResolutionScale; }
 
 	glm::i32vec2 GetRenderResolution()
 	{
@@ -13,6 +13,28 @@ struct RendererSettings
 		ReSTIR = 3
 	};
 
+	enum class LightSamplingMode
+	{
+		Uniform = 0,
+		Power = 1,
+		LightBVH = 2,
+		ReGIR = 3,
+		Culled = 4
+	};
+
+	enum class SamplerType
+	{
+		WhiteNoise = 0,
+		BlueNoise = 1
+	};
+
+	enum class TonemapOperator
+	{
+		None = 0,
+		Reinhard = 1,
+		ACES = 2
+	};
+
 	RenderMode Mode = RenderMode::ReSTIR;
 
 	// General Settings
@@ -24,8 +46,32 @@ struct RendererSettings
 
 	uint32_t SamplesPerPixel = 1;
 
+	// Dynamic Resolution, renders at a scaled resolution that holds the frame time target and upscales to the frame size
+	bool DynamicResolution = false;
+	float TargetFrameTime = 33.3f; // Milliseconds
+	float MinResolutionScale = 0.5f;
+
 	bool RandomSeed = true;
 	float Eta = 0.001f;
+	// Random numbers of RIS candidates, temporal jitter and spatial neighbour choice
+	SamplerType Sampler = SamplerType::WhiteNoise;
+
+	// Average the HDR output over frames while the view, scene and settings don't change
+	bool ProgressiveAccumulation = false;
+
+	// Light Sampling, used by DI and ReSTIR RIS candidates
+	LightSamplingMode LightSampling = LightSamplingMode::Uniform;
+	int GridResolution = 16;
+	int GridResevoirsPerCell = 8;
+	int GridCandidatesPerCell = 256;
+	// Influence culling, lights whose power falls below the cutoff at a cell are never sampled there (biased)
+	float InfluenceCutoff = 0.01f;
+	float CullingCellSize = 2.0f;
+
+	// Display, only applied to the DI and ReSTIR HDR output
+	float Exposure = 1.0f;
+	TonemapOperator Tonemapper = TonemapOperator::None;
+	bool SRGBOutput = false;
 
 	// Normal Rendering
 	bool RenderPrevNormals = false;
@@ -36,10 +82,20 @@ struct RendererSettings
 	int CandidateCountDI = 1;
 
 	// ReSTIR Rendering
+	// Primary Visibility
+	bool PacketPrimaryRays = false;
+
 	// RIS
-	int CandidateCountReSTIR = 3;
+	int CandidateCountReSTIR = 3; // Average per pixel when the count is adaptive
+	bool AdaptiveCandidateCount = false;
+	int MinCandidateCountReSTIR = 1;
+	int MaxCandidateCountReSTIR = 16;
 	bool EnableVisibilityPass = true;
 
+	// Merge temporal and spatial candidates on geometry only and leave visibility to shading.
+	// Biased: occluded candidates can win the resevoir and darken the pixel for a frame.
+	bool DeferredReuseVisibility = false;
+
 	// Temporal Reuse
 	bool EnableTemporalReuse = true;
 	int TemporalSampleCountRatio = 15;
@@ -50,11 +106,26 @@ struct RendererSettings
 	// Spatial Reuse
 	bool EnableSpatialReuse = true;
 	int SpatialReuseNeighbours = 3;
+	int SpatialReuseInterval = 1; // 1 in N pixels resample spatially per frame, 2 is a checkerboard
 	int SpatialPixelRadius = 10;
 	float SpatialMaxDistance = 0.160f;
 	float SpatialMaxDistanceDepthScaling = 0.020f;
 	float SpatialMinNormalSimilarity = 0.96f;
 
+	// Variable Rate Shading, flat and still tiles run RIS and reuse for 1/2 or 1/4 of their pixels per frame.
+	// Skipped pixels carry their reprojected resevoir forward and are reconstructed from shaded neighbours.
+	bool VariableRateShading = false;
+	float ShadingRateVarianceThreshold = 0.5f; // Relative luminance variance of a tile below which it is shaded at 1/2 rate, 1/4 below a quarter of it
+	float ShadingRateDepthThreshold = 0.05f; // Relative depth step between neighbours that marks an edge
+	float ShadingRateMotionThreshold = 0.5f; // Object motion in pixels
+
+	// Denoiser, edge-aware a-trous filter on the shaded radiance
+	bool Denoise = false;
+	int DenoiseIterations = 4;
+	float DenoiseHistoryAlpha = 0.2f;
+	float DenoiseColorPhi = 4.0f;
+	float DenoiseDepthPhi = 1.0f;
+
 	bool operator==(const RendererSettings& otherSettings)
 	{
 		bool sameSettings = true;
@@ -67,8 +138,22 @@ struct RendererSettings
 		sameSettings &= TileSize == otherSettings.TileSize;
 		sameSettings &= SamplesPerPixel == otherSettings.SamplesPerPixel;
 
+		// Dynamic resolution settings are left out, the history is reprojected across resolution changes
+
 		sameSettings &= RandomSeed == otherSettings.RandomSeed;
 		sameSettings &= Eta == otherSettings.Eta;
+		sameSettings &= Sampler == otherSettings.Sampler;
+		// ProgressiveAccumulation is left out, it restarts the average itself when toggled
+
+		// Light Sampling
+		sameSettings &= LightSampling == otherSettings.LightSampling;
+		sameSettings &= GridResolution == otherSettings.GridResolution;
+		sameSettings &= GridResevoirsPerCell == otherSettings.GridResevoirsPerCell;
+		sameSettings &= GridCandidatesPerCell == otherSettings.GridCandidatesPerCell;
+		sameSettings &= InfluenceCutoff == otherSettings.InfluenceCutoff;
+		sameSettings &= CullingCellSize == otherSettings.CullingCellSize;
+
+		// Display settings are left out, they don't affect the resevoir history
 
 		// Normal Rendering
 		RenderPrevNormals = otherSettings.RenderPrevNormals;
@@ -79,10 +164,17 @@ struct RendererSettings
 
 		sameSettings &= CandidateCountDI == otherSettings.CandidateCountDI;
 
+		// Packet tracing finds the same primary hits, so PacketPrimaryRays is left out
+
 		// ReSTIR RIS
 		sameSettings &= CandidateCountReSTIR == otherSettings.CandidateCountReSTIR;
+		sameSettings &= AdaptiveCandidateCount == otherSettings.AdaptiveCandidateCount;
+		sameSettings &= MinCandidateCountReSTIR == otherSettings.MinCandidateCountReSTIR;
+		sameSettings &= MaxCandidateCountReSTIR == otherSettings.MaxCandidateCountReSTIR;
 		sameSettings &= EnableVisibilityPass == otherSettings.EnableVisibilityPass;
 
+		sameSettings &= DeferredReuseVisibility == otherSettings.DeferredReuseVisibility;
+
 		// ReSTIR Temporal Reuse
 		sameSettings &= EnableTemporalReuse == otherSettings.EnableTemporalReuse;
 		sameSettings &= TemporalMaxDistance == otherSettings.TemporalMaxDistance;
@@ -93,14 +185,37 @@ struct RendererSettings
 		// ReSTIR Spatial Reuse
 		sameSettings &= EnableSpatialReuse == otherSettings.EnableSpatialReuse;
 		sameSettings &= SpatialReuseNeighbours == otherSettings.SpatialReuseNeighbours;
+		sameSettings &= SpatialReuseInterval == otherSettings.SpatialReuseInterval;
 		sameSettings &= SpatialPixelRadius == otherSettings.SpatialPixelRadius;
 		sameSettings &= SpatialMaxDistance == otherSettings.SpatialMaxDistance;
 		sameSettings &= SpatialMaxDistanceDepthScaling == otherSettings.SpatialMaxDistanceDepthScaling;
 		sameSettings &= SpatialMinNormalSimilarity == otherSettings.SpatialMinNormalSimilarity;
 
+		// Variable Rate Shading
+		sameSettings &= VariableRateShading == otherSettings.VariableRateShading;
+		sameSettings &= ShadingRateVarianceThreshold == otherSettings.ShadingRateVarianceThreshold;
+		sameSettings &= ShadingRateDepthThreshold == otherSettings.ShadingRateDepthThreshold;
+		sameSettings &= ShadingRateMotionThreshold == otherSettings.ShadingRateMotionThreshold;
+
+		// Denoiser settings are left out, they don't affect the resevoir history. See SameOutput.
+
 		return sameSettings;
 	}
 
+	// Settings that change the rendered radiance without touching the resevoir history, progressive
+	// accumulation restarts when these differ. Sample counts already invalidate the history through operator==.
+	bool SameOutput(const RendererSettings& otherSettings) const
+	{
+		bool sameOutput = true;
+		sameOutput &= Denoise == otherSettings.Denoise;
+		sameOutput &= DenoiseIterations == otherSettings.DenoiseIterations;
+		sameOutput &= DenoiseHistoryAlpha == otherSettings.DenoiseHistoryAlpha;
+		sameOutput &= DenoiseColorPhi == otherSettings.DenoiseColorPhi;
+		sameOutput &= DenoiseDepthPhi == otherSettings.DenoiseDepthPhi;
+
+		return sameOutput;
+	}
+
 	bool operator!=(const RendererSettings& otherSettings)
 	{
 		return !operator==(otherSettings);
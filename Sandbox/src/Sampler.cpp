@@ -0,0 +1,60 @@
+#include "Sampler.h"
+
+#include <fstream>
+
+//=================== BlueNoiseTexture =====================
+
+bool BlueNoiseTexture::Load(const std::string& filepath)
+{
+	m_Texels.clear();
+
+	std::ifstream file(filepath, std::ios::binary);
+	if (!file)
+	{
+		std::cout << "Error Loading blue noise file: " << filepath << std::endl;
+		return false;
+	}
+
+	const uint32_t texelCount = Size * Size * PageCount;
+	std::vector<uint32_t> data(texelCount);
+	if (!file.read(reinterpret_cast<char*>(data.data()), texelCount * sizeof(uint32_t)))
+	{
+		std::cout << "Error Loading blue noise file: " << filepath << " is too small" << std::endl;
+		return false;
+	}
+
+	// Centered in their bucket so no value is exactly 0
+	m_Texels.resize(texelCount);
+	for (uint32_t i = 0; i < texelCount; i++)
+		m_Texels[i] = (glm::vec2((data[i] >> 16) & 255, (data[i] >> 8) & 255) + 0.5f) / 256.0f;
+
+	return true;
+}
+
+//=================== PixelSampler =====================
+
+glm::vec2 PixelSampler::Get2D()
+{
+	uint32_t dimension = m_Dimension++;
+	if (m_BlueNoise == nullptr)
+	{
+		float x = Utils::RandomFloat(m_Seed);
+		float y = Utils::RandomFloat(m_Seed);
+		return glm::min(glm::vec2(x, y), glm::vec2(0.99999994f));
+	}
+
+	// R2 sequence in 32 bit fixed point, wraps around instead of losing precision on long runs
+	const uint32_t r2X = 3242174889u;
+	const uint32_t r2Y = 2447445413u;
+	const float fixedPointScale = 1.0f / 4294967296.0f;
+
+	uint32_t offsetIndex = dimension + 1;
+	uint32_t offsetX = (offsetIndex * r2X) >> 25; // Top 7 bits, the texture is 128 texels wide
+	uint32_t offsetY = (offsetIndex * r2Y) >> 25;
+	const glm::vec2& texel = m_BlueNoise->GetTexel(m_Pixel.x + offsetX, m_Pixel.y + offsetY, m_FrameIndex + dimension);
+
+	uint32_t cycle = m_FrameIndex / BlueNoiseTexture::PageCount;
+	glm::vec2 shift = glm::vec2(static_cast<float>(cycle * r2X), static_cast<float>(cycle * r2Y)) * fixedPointScale;
+	glm::vec2 value = texel + shift;
+	return glm::min(value - glm::floor(value), glm::vec2(0.99999994f));
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Include.h"
+
+#include "Utils.h"
+
+// Tileable 2D blue noise with a page per frame, successive pages are blue noise over time as well
+class BlueNoiseTexture
+{
+public:
+	static constexpr uint32_t Size = 128; // Power of two
+	static constexpr uint32_t PageCount = 8; // Power of two
+private:
+	std::vector<glm::vec2> m_Texels;
+public:
+	BlueNoiseTexture() = default;
+	~BlueNoiseTexture() = default;
+
+	// Raw layout of one uint32 per texel with the two values in its second and third byte
+	bool Load(const std::string& filepath);
+	bool IsLoaded() const { return !m_Texels.empty(); }
+
+	const glm::vec2& GetTexel(uint32_t x, uint32_t y, uint32_t page) const
+	{
+		return m_Texels[(page & (PageCount - 1)) * Size * Size + (y & (Size - 1)) * Size + (x & (Size - 1))];
+	}
+};
+
+// Random numbers for one pixel and frame. With a blue noise texture every dimension reads its own
+// offset into the tiled texture, so neighbouring pixels get well spread values for the same decision.
+// The page steps with the frame and a golden ratio shift decorrelates the frames past the page count.
+// Without a texture it falls back to white noise drawn from the caller's seed.
+class PixelSampler
+{
+private:
+	const BlueNoiseTexture* m_BlueNoise;
+	glm::i32vec2 m_Pixel;
+	uint32_t m_FrameIndex;
+	uint32_t m_Dimension;
+	uint32_t& m_Seed;
+public:
+	PixelSampler(const BlueNoiseTexture* blueNoise, const glm::i32vec2 pixel, uint32_t frameIndex, uint32_t firstDimension, uint32_t& seed) :
+		m_BlueNoise{ blueNoise != nullptr && blueNoise->IsLoaded() ? blueNoise : nullptr }, m_Pixel{ pixel }, m_FrameIndex{ frameIndex }, m_Dimension{ firstDimension }, m_Seed{ seed }
+	{}
+
+	~PixelSampler() = default;
+
+	// Every call moves on to the next dimension, values lie in [0, 1)
+	float Get1D() { return Get2D().x; }
+	glm::vec2 Get2D();
+};
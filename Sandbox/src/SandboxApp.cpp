@@ -19,7 +19,7 @@ class RaytracerLayer : public Hazel::Layer
 {
 public:
 	RaytracerLayer() :
-		Layer("PathTracing")
+		Layer("PathTracing"), m_BLASCache(".\\cache\\blas")
 	{
 		// Lights
 		m_LightLocation = m_LightLocationSeed = 0;
@@ -37,21 +37,46 @@ public:
 		m_AutoTransform;
 		m_EnableAutoTransform;
 
-		uint32_t sponzaIndex = LoadObject(".\\assets\\models\\sponza_small.obj", "Sponza");
-		uint32_t sphereIndex = LoadObject(".\\assets\\models\\sphere_high_res.obj", "Sphere");
-		uint32_t dragonIndex = LoadObject(".\\assets\\models\\dragon_460k.obj", "Dragon");
-		uint32_t armadilloIndex = LoadObject(".\\assets\\models\\armadillo_small.obj", "Armadillo");
+		struct SceneObject
+		{
+			std::string name;
+			Transform transform;
+			glm::vec3 autoRotation; // Zero for objects that stand still
+		};
+
+		std::vector<GeometryLoader::ObjectLoadRequest> loadRequests = {
+			{ ".\\assets\\models\\sponza_small.obj", BLAS::BuildQuality::High },
+			{ ".\\assets\\models\\sphere_high_res.obj", BLAS::BuildQuality::High },
+			{ ".\\assets\\models\\dragon_460k.obj", BLAS::BuildQuality::High },
+			{ ".\\assets\\models\\armadillo_small.obj", BLAS::BuildQuality::High }
+		};
+		const SceneObject sceneObjects[] = {
+			{ "Sponza", Transform(glm::vec3(0), glm::vec3(0), glm::vec3(1)), glm::vec3(0) },
+			{ "Sphere", Transform(glm::vec3(3.850f, 0.3f, 0.400f), glm::vec3(0, 0, 0), glm::vec3(1)), glm::vec3(0) },
+			{ "Dragon", Transform(glm::vec3(12.350f, 0.850f, 0.650f), glm::vec3(0, 31.765f, 0), glm::vec3(1.5f)), glm::vec3(0.0f, -1.0f, 0.0f) },
+			{ "Armadillo", Transform(glm::vec3(5.550f, 0.0f, 2.650f), glm::vec3(0, 60.0f, 0), glm::vec3(1)), glm::vec3(0.0f, 2.0f, 0.0f) }
+		};
+		HZ_INFO("Loading {} Objects", loadRequests.size());
+		std::vector<std::shared_ptr<BLAS>> objects = GeometryLoader::LoadObjects(loadRequests, m_BLASCache, m_RendererSettingsUI.ThreadCount, ObjectLoadMemoryBudget);
+
+		for (uint32_t i = 0; i < objects.size(); i++)
+		{
+			// An object that failed to load is left out, the rest of the scene still renders
+			const SceneObject& sceneObject = sceneObjects[i];
+			if (objects[i] == nullptr)
+			{
+				HZ_ERROR("Failed to load {} from {}", sceneObject.name, loadRequests[i].filepath);
+				continue;
+			}
 
-		m_TLAS.GetTransformRef(sponzaIndex) = Transform(glm::vec3(0), glm::vec3(0), glm::vec3(1));
-		m_TLAS.GetTransformRef(sphereIndex) = Transform(glm::vec3(3.850f, 0.3f, 0.400f), glm::vec3(0, 0, 0), glm::vec3(1));
-		m_TLAS.GetTransformRef(dragonIndex) = Transform(glm::vec3(12.350f, 0.850f, 0.650f), glm::vec3(0, 31.765f, 0), glm::vec3(1.5f));
-		m_TLAS.GetTransformRef(armadilloIndex) = Transform(glm::vec3(5.550f, 0.0f, 2.650f), glm::vec3(0, 60.0f, 0), glm::vec3(1));
+			uint32_t index = AddObject(objects[i], sceneObject.name);
+			m_TLAS.GetTransformRef(index) = sceneObject.transform;
+			if (sceneObject.autoRotation != glm::vec3(0))
+				SetObjectAutoTransform(index, true, Transform(glm::vec3(0), sceneObject.autoRotation, glm::vec3(0)));
+		}
 		m_TLAS.UpdateTransform();
 		m_TLAS.Build();
 
-		SetObjectAutoTransform(armadilloIndex, true, Transform(glm::vec3(0), glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0)));
-		SetObjectAutoTransform(dragonIndex, true, Transform(glm::vec3(0), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0)));
-
 		// Setup Rendering
 		HZ_INFO("Initiating Renderer");
 		m_RendererSettingsUI;
@@ -70,7 +95,8 @@ public:
 		m_CameraFlyRotationSpeed = glm::vec3(0.0f, 0.0f, 0.0f);
 
 		m_Renderer;
-		m_Renderer.Init(m_RendererSettingsUI, Renderer::Scene(m_Camera, m_TLAS, m_pointLights));
+		m_Renderer.LoadBlueNoise("..\\tiny_bvh\\testdata\\blue_noise_128x128x8_2d.raw");
+		m_Renderer.Init(m_RendererSettingsUI, m_Camera, m_TLAS, m_LightBuffer);
 
 		FrameBufferRef frameBuffer = m_Renderer.GetFrameBuffer();
 		RenderCommand::GeneratePixelBufferObject(m_PixelBufferObjectID, frameBuffer, m_CurrentWidth, m_CurrentHeight);
@@ -113,7 +139,7 @@ public:
 		}
 
 		// Rigid object animations
-		for (int i = 0; i < m_TLAS.GetObjectCount(); i++)
+		for (int i = 0; i < m_TLAS.GetInstanceCount(); i++)
 		{
 			if (m_EnableAutoTransform[i])
 			{
@@ -134,7 +160,7 @@ public:
 
 		// Submit new scene
 		m_Renderer.SubmitRenderSettings(m_RendererSettingsUI);
-		m_Renderer.SubmitScene(Renderer::Scene(m_Camera, m_TLAS, m_pointLights));
+		m_Renderer.SubmitScene(m_Camera, m_TLAS, m_LightBuffer);
 	}
 
 	virtual void OnImGuiRender()
@@ -157,7 +183,7 @@ public:
 			// Performance Metrics Subwindow
 			ImGui::SetNextWindowBgAlpha(0.45f);
 			ImGui::SetNextWindowPos(ImVec2(viewportPosition.x + 16, viewportPosition.y + 36));
-			ImGui::SetNextWindowSize(ImVec2(110, 55));
+			ImGui::SetNextWindowSize(ImVec2(110, 67));
 			ImGui::Begin("Performance Metrics", NULL, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize);
 			ImGui::SetCursorPos(ImVec2(8, 8));
 			ImGui::Text("%dx%d", (int)(m_CurrentWidth), (int)(m_CurrentHeight));
@@ -165,6 +191,8 @@ public:
 			ImGui::Text("%.1f FPS", 1000.0f / m_Renderer.GetLastFrameTime());
 			ImGui::SetCursorPos(ImVec2(8, 32));
 			ImGui::Text("%.3f ms", m_Renderer.GetLastFrameTime());
+			ImGui::SetCursorPos(ImVec2(8, 44));
+			ImGui::Text("%.2f rays/px", m_Renderer.GetLastShadowRaysPerPixel());
 			ImGui::End();
 
 			// Controls Subwindow
@@ -216,8 +244,55 @@ public:
 			}
 			ImGui::DragFloat("Eta size", &m_RendererSettingsUI.Eta, 0.001f, 0.001f, 0.1f);
 			ImGui::Checkbox("Random Seed", &m_RendererSettingsUI.RandomSeed);
+			const char* SamplerTypes[] = { "White Noise", "Blue Noise" };
+			int selectedSampler = static_cast<int>(m_RendererSettingsUI.Sampler);
+			ImGui::Combo("Sampler", &selectedSampler, SamplerTypes, IM_ARRAYSIZE(SamplerTypes));
+			m_RendererSettingsUI.Sampler = static_cast<RendererSettings::SamplerType>(selectedSampler);
+			ImGui::Checkbox("Progressive Accumulation", &m_RendererSettingsUI.ProgressiveAccumulation);
+			if (m_RendererSettingsUI.ProgressiveAccumulation)
+				ImGui::Text("Accumulated Frames: %d", m_Renderer.GetAccumulatedFrameCount());
+			ImGui::Checkbox("Dynamic Resolution", &m_RendererSettingsUI.DynamicResolution);
+			if (m_RendererSettingsUI.DynamicResolution)
+			{
+				ImGui::DragFloat("Target Frame Time (ms)", &m_RendererSettingsUI.TargetFrameTime, 0.1f, 1.0f, 1000.0f);
+				ImGui::DragFloat("Min Resolution Scale", &m_RendererSettingsUI.MinResolutionScale, 0.01f, 0.1f, 1.0f);
+				ImGui::Text("Resolution Scale: %.0f%%", m_Renderer.GetResolutionScale() * 100.0f);
+			}
 			ImGui::Separator();
 
+			if (m_RendererSettingsUI.Mode == RendererSettings::RenderMode::DI || m_RendererSettingsUI.Mode == RendererSettings::RenderMode::ReSTIR)
+			{
+				ImGui::Text("Light Sampling");
+				const char* LightSamplingModes[] = { "Uniform", "Power (Alias Table)", "Light BVH", "ReGIR Grid", "Influence Culled" };
+				int selectedLightSampling = static_cast<int>(m_RendererSettingsUI.LightSampling);
+				ImGui::Combo("Light Selection", &selectedLightSampling, LightSamplingModes, IM_ARRAYSIZE(LightSamplingModes));
+				m_RendererSettingsUI.LightSampling = static_cast<RendererSettings::LightSamplingMode>(selectedLightSampling);
+				if (m_RendererSettingsUI.LightSampling == RendererSettings::LightSamplingMode::ReGIR)
+				{
+					if (ImGui::InputInt("Grid Resolution", &m_RendererSettingsUI.GridResolution))
+						m_RendererSettingsUI.GridResolution = std::min(std::max(1, m_RendererSettingsUI.GridResolution), 128);
+					if (ImGui::InputInt("Resevoirs Per Cell", &m_RendererSettingsUI.GridResevoirsPerCell))
+						m_RendererSettingsUI.GridResevoirsPerCell = std::min(std::max(1, m_RendererSettingsUI.GridResevoirsPerCell), 64);
+					if (ImGui::InputInt("Candidates Per Cell", &m_RendererSettingsUI.GridCandidatesPerCell))
+						m_RendererSettingsUI.GridCandidatesPerCell = std::max(m_RendererSettingsUI.GridResevoirsPerCell, m_RendererSettingsUI.GridCandidatesPerCell);
+				}
+				else if (m_RendererSettingsUI.LightSampling == RendererSettings::LightSamplingMode::Culled)
+				{
+					ImGui::DragFloat("Influence Cutoff", &m_RendererSettingsUI.InfluenceCutoff, 0.001f, 0.0001f, 1.0f, "%.4f");
+					ImGui::DragFloat("Cell Size", &m_RendererSettingsUI.CullingCellSize, 0.05f, 0.1f, 16.0f);
+				}
+				ImGui::Separator();
+
+				ImGui::Text("Display");
+				ImGui::DragFloat("Exposure", &m_RendererSettingsUI.Exposure, 0.01f, 0.0f, 32.0f);
+				const char* Tonemappers[] = { "None", "Reinhard", "ACES" };
+				int selectedTonemapper = static_cast<int>(m_RendererSettingsUI.Tonemapper);
+				ImGui::Combo("Tonemapper", &selectedTonemapper, Tonemappers, IM_ARRAYSIZE(Tonemappers));
+				m_RendererSettingsUI.Tonemapper = static_cast<RendererSettings::TonemapOperator>(selectedTonemapper);
+				ImGui::Checkbox("sRGB Output", &m_RendererSettingsUI.SRGBOutput);
+				ImGui::Separator();
+			}
+
 			if (m_RendererSettingsUI.Mode == RendererSettings::RenderMode::Normals)
 			{
 				ImGui::Text("Normal Rendering");
@@ -237,15 +312,29 @@ public:
 			}
 			else if (m_RendererSettingsUI.Mode == RendererSettings::RenderMode::ReSTIR)
 			{
+				ImGui::Text("Primary Visibility");
+				ImGui::Checkbox("Packet Traversal", &m_RendererSettingsUI.PacketPrimaryRays);
+				ImGui::Text("%.3f ms", m_Renderer.GetLastPrimaryVisibilityTime());
+				ImGui::Separator();
+
 				// Streaming RIS
 				ImGui::Text("Streaming RIS");
 				if (ImGui::InputInt("Candidate Count", &m_RendererSettingsUI.CandidateCountReSTIR))
 				{
 					m_RendererSettingsUI.CandidateCountReSTIR = m_RendererSettingsUI.CandidateCountReSTIR < 1 ? 1 : m_RendererSettingsUI.CandidateCountReSTIR;
 				}
+				ImGui::Checkbox("Adaptive Candidate Count", &m_RendererSettingsUI.AdaptiveCandidateCount);
+				if (m_RendererSettingsUI.AdaptiveCandidateCount)
+				{
+					if (ImGui::InputInt("Min Candidates", &m_RendererSettingsUI.MinCandidateCountReSTIR))
+						m_RendererSettingsUI.MinCandidateCountReSTIR = std::max(1, m_RendererSettingsUI.MinCandidateCountReSTIR);
+					if (ImGui::InputInt("Max Candidates", &m_RendererSettingsUI.MaxCandidateCountReSTIR))
+						m_RendererSettingsUI.MaxCandidateCountReSTIR = std::max(m_RendererSettingsUI.MinCandidateCountReSTIR, m_RendererSettingsUI.MaxCandidateCountReSTIR);
+				}
 				ImGui::Separator();
 				ImGui::Text("Visibility Pass");
 				ImGui::Checkbox("Enable", &m_RendererSettingsUI.EnableVisibilityPass);
+				ImGui::Checkbox("Deferred Reuse Visibility", &m_RendererSettingsUI.DeferredReuseVisibility);
 				ImGui::Separator();
 
 				// Temporal Reuse
@@ -276,11 +365,39 @@ public:
 				{
 					m_RendererSettingsUI.SpatialPixelRadius = m_RendererSettingsUI.SpatialPixelRadius < 3 ? 3 : m_RendererSettingsUI.SpatialPixelRadius;
 				}
+				if (ImGui::InputInt("Pixel Interval", &m_RendererSettingsUI.SpatialReuseInterval))
+				{
+					m_RendererSettingsUI.SpatialReuseInterval = std::min(std::max(1, m_RendererSettingsUI.SpatialReuseInterval), 16);
+				}
 				ImGui::DragFloat("Max Distance", &m_RendererSettingsUI.SpatialMaxDistance, 0.001f, 0.0f, 1.0f);
 				ImGui::DragFloat("Max Distance Depth Scaling", &m_RendererSettingsUI.SpatialMaxDistanceDepthScaling, 0.001f, 0.0f, 5.0f);
 				ImGui::DragFloat("Min Normal Similarity", &m_RendererSettingsUI.SpatialMinNormalSimilarity, 0.001f, 0.0f, 1.0f);
 				ImGui::Separator();
 				ImGui::PopID();
+
+				// Variable Rate Shading
+				ImGui::PushID("Variable Rate Shading Options");
+				ImGui::Text("Variable Rate Shading");
+				ImGui::Checkbox("Enable", &m_RendererSettingsUI.VariableRateShading);
+				ImGui::DragFloat("Variance Threshold", &m_RendererSettingsUI.ShadingRateVarianceThreshold, 0.01f, 0.0f, 16.0f);
+				ImGui::DragFloat("Depth Threshold", &m_RendererSettingsUI.ShadingRateDepthThreshold, 0.001f, 0.001f, 1.0f);
+				ImGui::DragFloat("Motion Threshold", &m_RendererSettingsUI.ShadingRateMotionThreshold, 0.01f, 0.0f, 16.0f);
+				ImGui::Separator();
+				ImGui::PopID();
+
+				// Denoiser
+				ImGui::PushID("Denoiser Options");
+				ImGui::Text("Denoiser");
+				ImGui::Checkbox("Enable", &m_RendererSettingsUI.Denoise);
+				if (ImGui::InputInt("Filter Iterations", &m_RendererSettingsUI.DenoiseIterations))
+				{
+					m_RendererSettingsUI.DenoiseIterations = std::min(std::max(0, m_RendererSettingsUI.DenoiseIterations), 6);
+				}
+				ImGui::DragFloat("History Alpha", &m_RendererSettingsUI.DenoiseHistoryAlpha, 0.001f, 0.01f, 1.0f);
+				ImGui::DragFloat("Color Phi", &m_RendererSettingsUI.DenoiseColorPhi, 0.01f, 0.1f, 64.0f);
+				ImGui::DragFloat("Depth Phi", &m_RendererSettingsUI.DenoiseDepthPhi, 0.01f, 0.1f, 64.0f);
+				ImGui::Separator();
+				ImGui::PopID();
 			}
 
 			ImGui::End();
@@ -313,7 +430,7 @@ public:
 			// Draw Scene
 			DrawImGUiTreeNodeEX(0, "Camera");
 			DrawImGUiTreeNodeEX(1, "Lights");
-			for (uint32_t i = 0; i < m_TLAS.GetObjectCount(); i++)
+			for (uint32_t i = 0; i < m_TLAS.GetInstanceCount(); i++)
 			{
 				DrawImGUiTreeNodeEX(i + 2, m_ObjectNames[i].c_str());
 			}
@@ -368,7 +485,7 @@ public:
 				ImGui::Text("Light Properties");
 				ImGui::Separator();
 				ImGui::PushItemWidth(-ImGui::GetWindowWidth() * 0.75f);
-				ImGui::DragInt("Count", &m_LightCount, 1, 0, 10000);
+				ImGui::DragInt("Count", &m_LightCount, 1, 0, 1000000);
 				ImGui::DragInt("Color Seed", &m_LightColor, 1, 0, 1000);
 				ImGui::DragInt("Location Seed", &m_LightLocation, 1, 0, 1000);
 
@@ -385,31 +502,43 @@ public:
 
 				ImGui::PopID();
 			}
-			else if (2 <= m_SelectedNode && m_SelectedNode < m_TLAS.GetObjectCount() + 2)
+			else if (2 <= m_SelectedNode && m_SelectedNode < m_TLAS.GetInstanceCount() + 2)
 			{
-				uint32_t blasIndex = m_SelectedNode - 2;
+				uint32_t instanceIndex = m_SelectedNode - 2;
 				bool transformUpdated = false;
 
-				ImGui::PushID(char(blasIndex));
-				ImGui::InputText("Name", &m_ObjectNames[blasIndex]);
+				ImGui::PushID(char(instanceIndex));
+				ImGui::InputText("Name", &m_ObjectNames[instanceIndex]);
 				ImGui::Separator();
 
 				ImGui::Text("Transform");
-				ImGui::DragFloat3("Position", glm::value_ptr(m_TLAS.GetTransformRef(blasIndex).translation), 0.05f);
-				ImGui::DragFloat3("Rotation", glm::value_ptr(m_TLAS.GetTransformRef(blasIndex).rotation), 0.05f);
-				if (ImGui::DragFloat3("Scale", glm::value_ptr(m_TLAS.GetTransformRef(blasIndex).scale), 0.05f))
+				ImGui::DragFloat3("Position", glm::value_ptr(m_TLAS.GetTransformRef(instanceIndex).translation), 0.05f);
+				ImGui::DragFloat3("Rotation", glm::value_ptr(m_TLAS.GetTransformRef(instanceIndex).rotation), 0.05f);
+				if (ImGui::DragFloat3("Scale", glm::value_ptr(m_TLAS.GetTransformRef(instanceIndex).scale), 0.05f))
 				{
 					// Prevent crashing due to NaN rays
-					m_TLAS.GetTransformRef(blasIndex).scale.x = std::max(0.00000001f, m_TLAS.GetTransformRef(blasIndex).scale.x);
-					m_TLAS.GetTransformRef(blasIndex).scale.y = std::max(0.00000001f, m_TLAS.GetTransformRef(blasIndex).scale.y);
-					m_TLAS.GetTransformRef(blasIndex).scale.z = std::max(0.00000001f, m_TLAS.GetTransformRef(blasIndex).scale.z);
+					m_TLAS.GetTransformRef(instanceIndex).scale.x = std::max(0.00000001f, m_TLAS.GetTransformRef(instanceIndex).scale.x);
+					m_TLAS.GetTransformRef(instanceIndex).scale.y = std::max(0.00000001f, m_TLAS.GetTransformRef(instanceIndex).scale.y);
+					m_TLAS.GetTransformRef(instanceIndex).scale.z = std::max(0.00000001f, m_TLAS.GetTransformRef(instanceIndex).scale.z);
 				}
 				ImGui::Separator();
 				ImGui::Text("Animation");
-				ImGui::Checkbox("Enable", (bool*)(&(m_EnableAutoTransform[blasIndex])));
-				ImGui::DragFloat3("Translation Speed", glm::value_ptr(m_AutoTransform[blasIndex].translation), 0.05f);
-				ImGui::DragFloat3("Rotation Speed", glm::value_ptr(m_AutoTransform[blasIndex].rotation), 0.05f);
-				ImGui::DragFloat3("Scale Speed", glm::value_ptr(m_AutoTransform[blasIndex].scale), 0.05f);
+				ImGui::Checkbox("Enable", (bool*)(&(m_EnableAutoTransform[instanceIndex])));
+				ImGui::DragFloat3("Translation Speed", glm::value_ptr(m_AutoTransform[instanceIndex].translation), 0.05f);
+				ImGui::DragFloat3("Rotation Speed", glm::value_ptr(m_AutoTransform[instanceIndex].rotation), 0.05f);
+				ImGui::DragFloat3("Scale Speed", glm::value_ptr(m_AutoTransform[instanceIndex].scale), 0.05f);
+				ImGui::Separator();
+
+				ImGui::Text("Instancing");
+				ImGui::CheckboxFlags("Visible", &m_TLAS.GetMaskRef(instanceIndex), RayMaskPrimary);
+				ImGui::CheckboxFlags("Casts Shadows", &m_TLAS.GetMaskRef(instanceIndex), RayMaskShadow);
+				if (ImGui::Button("Add Instance"))
+				{
+					// Shares the geometry and BVH, placed next to the original
+					Transform instanceTransform = m_TLAS.GetTransformRef(instanceIndex);
+					instanceTransform.translation.x += 1.0f;
+					AddInstance(m_TLAS.GetBLASHandle(instanceIndex), instanceTransform, m_ObjectNames[instanceIndex] + " Instance");
+				}
 				ImGui::Separator();
 
 				ImGui::PopID();
@@ -445,8 +574,10 @@ private:
 	glm::vec3 m_CameraFlyRotationSpeed;
 
 	// World state
+	static constexpr size_t ObjectLoadMemoryBudget = size_t(4) << 30; // Bytes
+	BLASCache m_BLASCache;
 	TLAS m_TLAS;
-	std::vector<PointLight> m_pointLights;
+	LightBufferRef m_LightBuffer;
 	float m_LightStrength;
 	int m_LightCount;
 	int m_LightColor;
@@ -503,8 +634,10 @@ private:
 				{
 					std::string objFilePath;
 					if (GetObjFilePath(objFilePath))
-						LoadObject(objFilePath);
+						ImportObject(objFilePath);
 				}
+				if (ImGui::MenuItem("Optimize Cached BVHs"))
+					OptimizeBLASCache();
 				ImGui::EndMenu();
 			}
 			ImGui::EndMenuBar();
@@ -514,8 +647,8 @@ private:
 
 	void GenerateLights()
 	{
-		m_pointLights = std::vector<PointLight>();
-		m_pointLights.reserve(m_LightCount);
+		std::vector<PointLight> pointLights;
+		pointLights.reserve(m_LightCount);
 
 		HZ_INFO("Generating {} Lights", m_LightCount);
 		for (int i = 0; i < m_LightCount; i++)
@@ -532,29 +665,29 @@ private:
 			float b = std::max(0.2f, Utils::RandomFloat(m_LightColorSeed));
 			glm::vec3 emissiveColor = glm::vec3(r, g, b);
 
-			m_pointLights.emplace_back(position, emissiveColor, m_LightStrength);
+			pointLights.emplace_back(position, emissiveColor, m_LightStrength);
 		}
+
+		m_LightBuffer = std::make_shared<const LightBuffer>(std::move(pointLights));
 	}
 
-	uint32_t LoadObject(const std::string& fileName, const std::string& objectName)
+	uint32_t AddObject(const std::shared_ptr<BLAS>& blas, const std::string& objectName)
 	{
-		// Load object
-		HZ_INFO("Loading Object {} from {}", objectName, fileName);
-		std::vector<tinybvh::bvhvec4> vertexBuffer;
-		GeometryLoader::LoadObj(fileName, vertexBuffer);
-
-		std::shared_ptr<BLAS> blas = std::make_shared<BLAS>();
 		Transform objectTransform;
 		objectTransform.translation = m_Camera.position + m_Camera.Forward() * 3.5f;
-		blas->SetObject(vertexBuffer);
 
+		return AddInstance(m_TLAS.AddBLAS(blas), objectTransform, objectName);
+	}
+
+	uint32_t AddInstance(uint32_t blasHandle, const Transform& transform, const std::string& instanceName)
+	{
 		AddObjectToRotationList();
-		m_ObjectNames.push_back(objectName);
+		m_ObjectNames.push_back(instanceName);
 
-		return m_TLAS.AddBLAS(blas, objectTransform);
+		return m_TLAS.AddInstance(blasHandle, transform);
 	}
 
-	uint32_t LoadObject(const std::string& fileName)
+	void ImportObject(const std::string& fileName)
 	{
 		// Get objectName from fileName
 		std::string objectName = fileName;
@@ -570,18 +703,32 @@ private:
 
 		// Load object
 		HZ_INFO("Loading Object {} from {}", objectName, fileName);
-		std::vector<tinybvh::bvhvec4> vertexBuffer;
-		GeometryLoader::LoadObj(fileName, vertexBuffer);
-
-		std::shared_ptr<BLAS> blas = std::make_shared<BLAS>();
-		Transform objectTransform;
-		objectTransform.translation = m_Camera.position + m_Camera.Forward() * 3.5f;
-		blas->SetObject(vertexBuffer);
+		std::vector<std::shared_ptr<BLAS>> objects = GeometryLoader::LoadObjects({ { fileName, BLAS::BuildQuality::High } }, m_BLASCache, m_RendererSettingsUI.ThreadCount, ObjectLoadMemoryBudget);
+		if (objects[0] == nullptr)
+		{
+			HZ_ERROR("Failed to load {} from {}", objectName, fileName);
+			return;
+		}
 
-		AddObjectToRotationList();
-		m_ObjectNames.push_back(objectName);
+		AddObject(objects[0], objectName);
+	}
 
-		return m_TLAS.AddBLAS(blas, objectTransform);
+	void OptimizeBLASCache()
+	{
+		// Blocks the UI, the optimized BVHs are used from the next launch on
+		std::vector<uint8_t> optimized(m_TLAS.GetBLASCount(), 0);
+		for (uint32_t i = 0; i < m_TLAS.GetInstanceCount(); i++)
+		{
+			// Instances share their BLAS, named after the first one
+			uint32_t blasHandle = m_TLAS.GetBLASHandle(i);
+			if (optimized[blasHandle])
+				continue;
+
+			optimized[blasHandle] = 1;
+			HZ_INFO("Optimizing cached BVH of {}", m_ObjectNames[i]);
+			if (!m_TLAS.GetBLAS(blasHandle)->OptimizeCacheEntry(m_BLASCache, 25))
+				HZ_INFO("No cached BVH or no improvement for {}", m_ObjectNames[i]);
+		}
 	}
 
 	void SetObjectAutoTransform(uint32_t index, bool enable, const Transform& transform = Transform())
@@ -0,0 +1,53 @@
+#include "ShadowRayBatch.h"
+
+#include <algorithm>
+
+void ShadowRayBatch::Reserve(uint32_t rayCount)
+{
+	m_Rays.reserve(rayCount);
+	m_SortKeys.reserve(rayCount);
+	m_Occluded.reserve(rayCount);
+	m_SortedRays.reserve(rayCount);
+	m_SortedOccluded.reserve(rayCount);
+}
+
+void ShadowRayBatch::Clear()
+{
+	m_Rays.clear();
+	m_SortKeys.clear();
+	m_Occluded.clear();
+	m_SortedRays.clear();
+	m_SortedOccluded.clear();
+}
+
+void ShadowRayBatch::Add(const glm::vec3& hitPosition, const glm::vec3& lightPosition, uint32_t lightIndex, float eta, uint32_t payload)
+{
+	glm::vec3 direction = lightPosition - hitPosition;
+	float distance = glm::length(direction);
+	direction = glm::normalize(direction);
+
+	uint32_t rayIndex = m_Rays.size();
+	m_Rays.push_back({ hitPosition + eta * direction, distance - 2.0f * eta, direction, payload });
+
+	uint64_t octant = (direction.x < 0.0f ? 1 : 0) | (direction.y < 0.0f ? 2 : 0) | (direction.z < 0.0f ? 4 : 0);
+	m_SortKeys.push_back((static_cast<uint64_t>(lightIndex) << 35) | (octant << 32) | rayIndex);
+}
+
+void ShadowRayBatch::Trace(const TLAS& tlas)
+{
+	std::sort(m_SortKeys.begin(), m_SortKeys.end());
+
+	m_SortedRays.clear();
+	for (uint64_t sortKey : m_SortKeys)
+	{
+		const ShadowRay& shadowRay = m_Rays[static_cast<uint32_t>(sortKey & 0xFFFFFFFF)];
+		m_SortedRays.push_back(Ray(shadowRay.origin, shadowRay.direction, shadowRay.distance, RayMaskShadow));
+	}
+
+	m_SortedOccluded.resize(m_SortedRays.size());
+	tlas.IsOccluded(m_SortedRays.data(), m_SortedRays.size(), m_SortedOccluded.data());
+
+	m_Occluded.resize(m_Rays.size());
+	for (uint32_t i = 0; i < m_SortKeys.size(); i++)
+		m_Occluded[static_cast<uint32_t>(m_SortKeys[i] & 0xFFFFFFFF)] = m_SortedOccluded[i];
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Include.h"
+
+#include "AccelerationStructures.h"
+
+// Collects the shadow rays of a tile so they can be traced together. Rays are sorted by
+// light and direction octant and traced as TLAS streams, so rays from neighbouring pixels
+// towards the same light share their TLAS traversal and the BVH nodes that are in cache.
+class ShadowRayBatch
+{
+private:
+	struct ShadowRay
+	{
+		glm::vec3 origin;
+		float distance;
+		glm::vec3 direction;
+		uint32_t payload;
+	};
+
+	std::vector<ShadowRay> m_Rays;
+	std::vector<uint64_t> m_SortKeys; // Light index, direction octant and ray index
+	std::vector<uint8_t> m_Occluded;
+	std::vector<Ray> m_SortedRays;
+	std::vector<uint8_t> m_SortedOccluded;
+public:
+	ShadowRayBatch() = default;
+	~ShadowRayBatch() = default;
+
+	void Reserve(uint32_t rayCount);
+	void Clear();
+
+	// Payload is returned unchanged with the result, e.g. the buffer index the ray belongs to
+	void Add(const glm::vec3& hitPosition, const glm::vec3& lightPosition, uint32_t lightIndex, float eta, uint32_t payload);
+	void Trace(const TLAS& tlas);
+
+	uint32_t GetRayCount() const { return m_Rays.size(); }
+	uint32_t GetPayload(uint32_t rayIndex) const { return m_Rays[rayIndex].payload; }
+	bool IsOccluded(uint32_t rayIndex) const { return m_Occluded[rayIndex] != 0; }
+};
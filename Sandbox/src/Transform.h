@@ -31,12 +31,12 @@ struct Transform
 		return glm::inverse(GetTransformMatrix());
 	}
 
-	bool operator==(const Transform& otherTransform)
+	bool operator==(const Transform& otherTransform) const
 	{
 		return translation == otherTransform.translation && rotation == otherTransform.rotation && scale == otherTransform.scale;
 	}
 
-	bool operator!=(const Transform& otherTransform)
+	bool operator!=(const Transform& otherTransform) const
 	{
 		return !operator==(otherTransform);
 	}
@@ -9,16 +9,6 @@ namespace Utils
         return std::min(max, std::max(min, value));
     }
 
-	static inline void FillFrameBufferPixel(uint32_t x, uint32_t y, glm::vec4 color, uint32_t width, FrameBufferRef frameBuffer)
-	{
-		int pixelIndex = (x + y * width) * 4;
-
-        frameBuffer.get()[0][pixelIndex + 0] = static_cast<unsigned char>(Clamp(color.x * 255.0f, 255.0f, 0.0f));
-        frameBuffer.get()[0][pixelIndex + 1] = static_cast<unsigned char>(Clamp(color.y * 255.0f, 255.0f, 0.0f));
-        frameBuffer.get()[0][pixelIndex + 2] = static_cast<unsigned char>(Clamp(color.z * 255.0f, 255.0f, 0.0f));
-        frameBuffer.get()[0][pixelIndex + 3] = static_cast<unsigned char>(Clamp(color.w * 255.0f, 255.0f, 0.0f));
-	}
-
     static inline uint32_t PCGHash(uint32_t& seed)
     {
         uint32_t state = seed * 747796405u + 2891336453u;
@@ -43,25 +33,10 @@ namespace Utils
 
     static inline int RandomInt(int minInclusive, int maxExclusive, uint32_t& seed)
     {
-        float delta = RandomFloat(seed) * static_cast<float>(maxExclusive - 1 - minInclusive);
+        float delta = RandomFloat(seed) * static_cast<float>(maxExclusive - minInclusive);
         int randomInt = minInclusive + static_cast<int>(delta);
 
-        return std::max(minInclusive, randomInt);
-    }
-
-    static inline glm::i32vec2 GetNeighbourPixel(glm::i32vec2 pixel, glm::i32vec2 resolution, uint32_t radius, uint32_t& seed)
-    {
-        glm::i32vec2 neighbourPixel = glm::i32vec2(-1, -1);
-        uint32_t doubleRadius = radius << 2;
-
-        // Check if neighour is within the frame and max radius
-        while (0 > neighbourPixel.x || neighbourPixel.x >= resolution.x || 0 > neighbourPixel.y || neighbourPixel.y >= resolution.y || (neighbourPixel - pixel).length() >= radius)
-        {
-            neighbourPixel.x = pixel.x + (Utils::RandomInt(0, doubleRadius, seed) - radius);
-            neighbourPixel.y = pixel.y + (Utils::RandomInt(0, doubleRadius, seed) - radius);
-        }
-
-        return neighbourPixel;
+        return std::min(maxExclusive - 1, std::max(minInclusive, randomInt));
     }
 
     static inline glm::vec3 TriangleNormal(const glm::vec3& vertex0, const glm::vec3& vertex1, const glm::vec3& vertex2)